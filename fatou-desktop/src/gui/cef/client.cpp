@@ -76,6 +76,7 @@ bool BrowserClient::OnProcessMessageReceived(
         renderAreaRect =
             IRect({uint32_t(ag->GetInt(0)), uint32_t(ag->GetInt(1)),
                    uint32_t(ag->GetInt(2)), uint32_t(ag->GetInt(3))});
+        wakeMainLoop();
         return true;
     } else if (message_name == "loadPreset") {
         const auto ag = message->GetArgumentList();
@@ -83,6 +84,7 @@ bool BrowserClient::OnProcessMessageReceived(
         std::cout << "load preset " << st << std::endl;
 
         presetLoader.enqueue(st);
+        wakeMainLoop();
 
         return true;
     }
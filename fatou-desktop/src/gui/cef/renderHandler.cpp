@@ -1,6 +1,10 @@
 #include "renderHandler.h"
 
 #include "../../window/sharedTexture.h"
+#include "../../window/guiTexture.h"
+
+#include <include/cef_task.h>
+#include <include/base/cef_callback.h>
 
 #include "webp/encode.h"
 #include <fstream>
@@ -13,6 +17,11 @@ inline bool fileExists(const std::string &name) {
     return f.good();
 }
 
+// paints the whole view again, see OnPaint
+static void repaint(CefRefPtr<CefBrowser> browser) {
+    browser->GetHost()->Invalidate(PET_VIEW);
+}
+
 void RenderHandler::OnPaint(CefRefPtr<CefBrowser> browser,
                             PaintElementType type, const RectList &dirtyRects,
                             const void *buffer, int width, int height) {
@@ -37,6 +46,10 @@ void RenderHandler::OnPaint(CefRefPtr<CefBrowser> browser,
         std::cerr << "Texture not defined!" << std::endl;
         return;
     }
+    if (targetTexture->w != width || targetTexture->h != height) {
+        // resized, CEF paints again with the new size
+        return;
+    }
 
     // TODO: There is sometimes an access violation exception during startup
     // when vkcopy (or transition image layout?) is run from here! Fix this! Not
@@ -44,7 +57,21 @@ void RenderHandler::OnPaint(CefRefPtr<CefBrowser> browser,
 
     // TODO: use a shared D3D11-Texture instead! VK_NV_external_memory allows
     // importing d3d11 memory to vulkan
-    targetTexture->update((const uint8_t *)buffer);
+    // only the dirty part, e.g. a blinking cursor is a few hundred pixels
+    vector<vk::Rect2D> rects;
+    rects.reserve(dirtyRects.size());
+    for (const CefRect &r : dirtyRects) {
+        const vk::Extent2D extent(uint32_t(std::max(r.width, 0)),
+                                  uint32_t(std::max(r.height, 0)));
+        rects.push_back(vk::Rect2D({r.x, r.y}, extent));
+    }
+    // Never waits for the render loop, see GuiTexture. While the texture is
+    // still being uploaded, the paint is skipped and requested again a frame
+    // later, in case nothing else changes meanwhile.
+    if (targetTexture->paint((const uint8_t *)buffer, rects))
+        wakeMainLoop();
+    else
+        CefPostDelayedTask(TID_UI, base::BindOnce(repaint, browser), 16);
 
     lk.unlock();
 
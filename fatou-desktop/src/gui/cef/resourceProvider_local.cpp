@@ -7,27 +7,28 @@
 #include "../../window/console.h"
 #include "../../shaderc/database.h"
 
-CefRefPtr<CefStreamReader> GetResourceReader(const std::string &resource_path) {
-    std::cout << "Reading resource " << resource_path << std::endl;
-
-    // TODO: sanitize path!
-    size_t pos = std::min(resource_path.find("?"), resource_path.length());
+// The resource relative to the resource directory, or an empty string if it
+// would leave it
+static string resourceName(const string &resource_path) {
+    size_t pos = std::min(resource_path.find_first_of("?#"),
+                          resource_path.length());
     string fp = resource_path.substr(0, pos);
-    if (fp[0] == '/')
-        fp = fp.substr(1, fp.length());
     std::replace(fp.begin(), fp.end(), '\\', '/');
+    while (!fp.empty() && fp[0] == '/')
+        fp = fp.substr(1, fp.length());
 
-    std::cout << "Loading " << fp << std::endl;
-
-    // vector<unsigned char> buffer = readFile2<unsigned char>(fp);
-
-    auto buffer = fatouDB->getFile(fp.c_str());
+    for (const auto &part : path(fp)) {
+        if (part == ".." || part.has_root_name())
+            return "";
+    }
+    return fp;
+}
 
-    // TODO: Free?
-    unsigned char *buf = new unsigned char[buffer.size()];
-    memcpy(buf, buffer.data(), buffer.size());
-    return CefStreamReader::CreateForHandler(new CefByteReadHandler(
-        (const unsigned char *)buf, buffer.size(), nullptr));
+static CefRefPtr<CefStreamReader>
+streamFor(const uint8_t *data, size_t size,
+          CefRefPtr<CefBaseRefCounted> owner) {
+    return CefStreamReader::CreateForHandler(
+        new CefByteReadHandler(data, size, owner));
 }
 
 ResourceProvider_local::ResourceProvider_local(const string &root_url)
@@ -37,27 +38,77 @@ ResourceProvider_local::ResourceProvider_local(const string &root_url)
     createFatouDB();
 }
 
+CefRefPtr<CachedResource> ResourceProvider_local::load(const string &name) {
+    if (!fatouDB->fileExists(name))
+        return nullptr;
+    return new CachedResource(fatouDB->getFile(name));
+}
+
+CefRefPtr<CachedResource> ResourceProvider_local::cached(const string &name) {
+    // edited files must show up on the next reload
+    if (fatouDB->localDirectory().has_value())
+        return load(name);
+
+    const auto it = cache.find(name);
+    if (it != cache.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->second;
+    }
+
+    CefRefPtr<CachedResource> resource = load(name);
+    if (resource)
+        insert(name, resource);
+    return resource;
+}
+
+void ResourceProvider_local::insert(const string &key,
+                                    CefRefPtr<CachedResource> resource) {
+    const size_t size = resource->data.size();
+    if (size > cacheBytes / 4)
+        return;
+
+    lru.emplace_front(key, resource);
+    cache[key] = lru.begin();
+    usedBytes += size;
+
+    while (usedBytes > cacheBytes) {
+        usedBytes -= lru.back().second->data.size();
+        cache.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
 bool ResourceProvider_local::OnRequest(
     scoped_refptr<CefResourceManager::Request> request) {
     CEF_REQUIRE_IO_THREAD();
 
     const std::string &url = request->url();
     if (url.rfind(root_url_, 0) != 0L) {
-        std::cout << "Passing " << url << std::endl;
         // Not handled by this provider.
         return false;
     }
 
     CefRefPtr<CefResourceHandler> handler;
 
-    const std::string &relative_path = url.substr(root_url_.length());
-    if (!relative_path.empty()) {
+    const string name = resourceName(url.substr(root_url_.length()));
+    if (!name.empty()) {
+        const string mime = request->mime_type_resolver().Run(url);
+        CefResponse::HeaderMap headers;
+        CefRefPtr<CefStreamReader> stream;
+
+        // the pack lives as long as fatouDB, nothing to keep alive
+        const optional<AssetView> view = fatouDB->view(name);
+        if (view.has_value()) {
+            stream = streamFor(view->data, view->size, nullptr);
+        } else if (CefRefPtr<CachedResource> r = cached(name)) {
+            stream = streamFor(r->data.data(), r->data.size(), r.get());
+        } else {
+            std::cerr << "Missing resource " << name << std::endl;
+        }
 
-        CefRefPtr<CefStreamReader> stream =
-            GetResourceReader(relative_path.data());
         if (stream.get()) {
-            handler = new CefStreamResourceHandler(
-                request->mime_type_resolver().Run(url), stream);
+            handler =
+                new CefStreamResourceHandler(200, "OK", mime, headers, stream);
         }
     }
 
@@ -4,8 +4,28 @@
 #include <include/wrapper/cef_byte_read_handler.h>
 #include <include/wrapper/cef_resource_manager.h>
 
-// Provider implementation for loading BINARY resources from the current
-// executable.
+#include <list>
+#include <unordered_map>
+
+// A resource in the memory of the provider. Streams keep it alive while CEF
+// reads them, even if it is evicted meanwhile.
+class CachedResource : public CefBaseRefCounted {
+  public:
+    CachedResource(vector<uint8_t> data) : data(std::move(data)) {}
+
+    const vector<uint8_t> data;
+
+  private:
+    IMPLEMENT_REFCOUNTING(CachedResource);
+};
+
+// Provider implementation for loading the GUI from fatouDB. Uncompressed
+// resources in the asset pack are streamed right from its mapping, the others
+// are decompressed once and kept in a small LRU cache.
+//
+// Compressed ones are not passed on with Content-Encoding: Chromium adds
+// Accept-Encoding below the point where CefResourceManager intercepts, and
+// CEF doesn't decode the responses of a CefStreamResourceHandler.
 class ResourceProvider_local : public CefResourceManager::Provider {
   public:
     explicit ResourceProvider_local(const string &root_url);
@@ -13,7 +33,17 @@ class ResourceProvider_local : public CefResourceManager::Provider {
     bool OnRequest(scoped_refptr<CefResourceManager::Request> request) override;
 
   private:
+    CefRefPtr<CachedResource> cached(const string &name);
+    CefRefPtr<CachedResource> load(const string &name);
+    void insert(const string &key, CefRefPtr<CachedResource> resource);
+
     string root_url_;
 
+    // Only touched on the IO thread. The front of lru was used last.
+    static constexpr size_t cacheBytes = 32 << 20;
+    size_t usedBytes = 0;
+    std::list<std::pair<string, CefRefPtr<CachedResource>>> lru;
+    std::unordered_map<string, decltype(lru)::iterator> cache;
+
     DISALLOW_COPY_AND_ASSIGN(ResourceProvider_local);
 };
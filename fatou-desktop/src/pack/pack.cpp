@@ -0,0 +1,19 @@
+#include "../shaderc/assetPack.h"
+
+#include <iostream>
+
+// Builds the asset pack the app reads instead of the database, see
+// AssetPack. Usage: fatou-pack [resource directory] [pack]
+int main(int argc, char **argv) {
+    const path directory =
+        argc > 1 ? path(argv[1]) : std::filesystem::current_path() / "public";
+    const path file = argc > 2 ? path(argv[2]) : path("assets.pack");
+
+    try {
+        writeAssetPack(directory, file);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -3,46 +3,86 @@
 #include <iostream>
 #include <shaderc/shaderc.hpp>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 #include "shaderCache.h"
 
-// Compiles a shader to SPIR-V assembly. Returns the assembly text
-// as a string.
-std::string compile_file_to_assembly(const std::string &source_name,
-                                     shaderc_shader_kind kind,
-                                     const std::string &source,
-                                     bool optimize = false) {
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
+// Creating a compiler sets up glslang, so there is one for all compilations.
+// Compiling is const and may happen on several threads at once.
+static const shaderc::Compiler &compiler() {
+    static const shaderc::Compiler instance;
+    return instance;
+}
 
-    // Like -DMY_DEFINE=1
-    options.AddMacroDefinition("MY_DEFINE", "1");
-    if (optimize)
-        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+// Path of an #include "name" in the file at from, relative to its directory
+// like in C. <name> is resolved the same way.
+static path resolveInclude(const path &from, const string &name) {
+    return (from.parent_path() / name).lexically_normal();
+}
 
-    shaderc::AssemblyCompilationResult result =
-        compiler.CompileGlslToSpvAssembly(source, kind, source_name.c_str(),
-                                          options);
+// Reads included files from fatouDB like the shaders themselves
+class DatabaseIncluder : public shaderc::CompileOptions::IncluderInterface {
+    // owns the strings the result points to
+    struct Include {
+        shaderc_include_result result;
+        string name;
+        string content;
+    };
 
-    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
-        std::cerr << result.GetErrorMessage();
-        return "";
+  public:
+    shaderc_include_result *GetInclude(const char *requested,
+                                       shaderc_include_type type,
+                                       const char *requesting,
+                                       size_t depth) override {
+        Include *include = new Include();
+        const path p = resolveInclude(requesting, requested);
+        if (cache.exists(p)) {
+            include->name = p.generic_string();
+            include->content = cache.getSource(p);
+        } else {
+            // without a name, the content is reported as the error
+            include->content = "couldn't find " + p.generic_string();
+        }
+        include->result = {include->name.c_str(), include->name.size(),
+                           include->content.c_str(), include->content.size(),
+                           include};
+        return &include->result;
     }
 
-    return {result.cbegin(), result.cend()};
+    void ReleaseInclude(shaderc_include_result *data) override {
+        delete static_cast<Include *>(data->user_data);
+    }
+};
+
+// Splits a path of shaderVariant into the file and the macro of the variant
+static pair<path, string> splitVariant(const path &p) {
+    const string s = p.string();
+    const size_t i = s.rfind('#');
+    if (i == string::npos)
+        return {p, ""};
+    return {s.substr(0, i), s.substr(i + 1)};
 }
 
 // Compiles a shader to a SPIR-V binary. Returns the binary as
-// a vector of 32-bit words.
+// a vector of 32-bit words. Includes are resolved relative to source_name.
 std::vector<uint32_t> compile_file(const std::string &source_name,
                                    shaderc_shader_kind kind,
                                    const std::string &source,
-                                   bool optimize = false) {
-    shaderc::Compiler compiler;
+                                   bool optimize = false,
+                                   const vector<string> &macros = {}) {
     shaderc::CompileOptions options;
 
     // Like -DMY_DEFINE=1
     //options.AddMacroDefinition("MY_DEFINE", "1");
+    for (const string &macro : macros)
+        options.AddMacroDefinition(macro, "1");
+    options.SetIncluder(std::make_unique<DatabaseIncluder>());
     if (optimize)
         options.SetOptimizationLevel(shaderc_optimization_level_performance);
 
@@ -90,8 +130,8 @@ std::vector<uint32_t> compile_file(const std::string &source_name,
     
 
     std::cout << source << std::endl;*/
-    shaderc::SpvCompilationResult module =
-        compiler.CompileGlslToSpv(source, kind, source_name.c_str(), options);
+    shaderc::SpvCompilationResult module = compiler().CompileGlslToSpv(
+        source, kind, source_name.c_str(), options);
 
     if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
         const string str = module.GetErrorMessage();
@@ -102,54 +142,214 @@ std::vector<uint32_t> compile_file(const std::string &source_name,
     return {module.cbegin(), module.cend()};
 }
 
-void *copyVectorToArray(const vector<uint32_t> &vec, size_t &len) {
-    len = vec.size() * sizeof(uint32_t);
-    uint32_t *arr = new uint32_t[vec.size()];
-    std::copy(vec.begin(), vec.end(), arr);
-    return arr;
+// FNV-1a, just to notice changes
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
 }
 
-void *copyVectorToArray(const vector<uint8_t> &vec, size_t &len) {
-    len = vec.size() * sizeof(uint8_t);
-    uint8_t *arr = new uint8_t[vec.size()];
-    std::copy(vec.begin(), vec.end(), arr);
-    return arr;
+// Hashes all files source includes, also the ones in inactive branches of
+// the preprocessor. Editing one of them has to compile the shader again.
+static uint64_t hashIncludes(uint64_t hash, const path &file,
+                             const string &source, set<path> &seen) {
+    std::istringstream lines(source);
+    for (string line; std::getline(lines, line);) {
+        const size_t i = line.find_first_not_of(" \t");
+        if (i == string::npos || line.compare(i, 8, "#include") != 0)
+            continue;
+        const size_t open = line.find_first_of("\"<", i + 8);
+        const size_t close = open == string::npos
+                                 ? string::npos
+                                 : line.find_first_of("\">", open + 1);
+        if (close == string::npos)
+            continue;
+
+        const path p =
+            resolveInclude(file, line.substr(open + 1, close - open - 1));
+        if (!seen.insert(p).second || !cache.exists(p))
+            continue;
+        const string included = cache.getSource(p);
+        const string name = p.generic_string();
+        hash = hashBytes(hash, name.c_str(), name.size() + 1);
+        hash = hashBytes(hash, included.data(), included.size());
+        hash = hashIncludes(hash, p, included, seen);
+    }
+    return hash;
 }
 
-void *compileShaderFromFile(const path &path, bool isVertex, size_t &len) {
+// Key of the ShaderCache: everything compile_file depends on, including the
+// files source includes. Increment the version when the compile options
+// change.
+static uint64_t shaderHash(shaderc_shader_kind kind, const path &file,
+                           const string &source, bool optimize,
+                           const vector<string> &macros = {}) {
+    const uint32_t version = 2;
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hashBytes(hash, &version, sizeof(version));
+    hash = hashBytes(hash, &kind, sizeof(kind));
+    hash = hashBytes(hash, &optimize, sizeof(optimize));
+    for (const string &macro : macros)
+        hash = hashBytes(hash, macro.c_str(), macro.size() + 1);
+    hash = hashBytes(hash, source.data(), source.size());
 
-    auto spv = cache.getCompiled(path);
+    set<path> seen;
+    return hashIncludes(hash, file, source, seen);
+}
+
+vector<uint32_t> compileShaderFromFile(const path &path, bool isVertex) {
+    const shaderc_shader_kind kind =
+        isVertex ? shaderc_glsl_vertex_shader : shaderc_glsl_fragment_shader;
+    // the variants are cached separately, under the path with the macro
+    const auto [file, macro] = splitVariant(path);
+    vector<string> macros;
+    if (!macro.empty())
+        macros.push_back(macro);
+
+    const string kShaderSource = cache.getSource(file);
+    const uint64_t hash = shaderHash(kind, file, kShaderSource, true, macros);
+
+    auto spv = cache.getCompiled(path, hash);
     if (spv.has_value()) {
-        return copyVectorToArray(spv.value(), len);
+        return std::move(spv.value());
     }
 
-    const string kShaderSource = cache.getSource(path);
-
     { // Compiling with optimizing
-        /*auto assembly =
-            compile_file_to_assembly("shader_src",
-                                     isVertex ? shaderc_glsl_vertex_shader
-                                              : shaderc_glsl_fragment_shader,
-                                     kShaderSource, true);
-        std::cout << "Optimized SPIR-V assembly:" << std::endl
-                  << assembly << std::endl;
-
-        if (!assembly.length()) {
-            return nullptr;
-        }*/
-
-        auto spirv = compile_file("shader_src",
-                                  isVertex ? shaderc_glsl_vertex_shader
-                                           : shaderc_glsl_fragment_shader,
-                                  kShaderSource, true);
-        std::cout << "Compiled to an optimized binary module with "
-                  << spirv.size() << " words." << std::endl;
-
+        auto spirv = compile_file(file.string(), kind, kShaderSource, true,
+                                  macros);
         if (!spirv.size()) {
-            return nullptr;
+            return {};
         }
 
-        cache.store(path, spirv);
-        return copyVectorToArray(spirv, len);
+        cache.store(path, hash, spirv);
+        return spirv;
+    }
+}
+
+vector<uint32_t> compileComputeShaderFromFile(const path &path,
+                                              const path &entry) {
+    // cached separately from the fragment shader of the same source
+    auto cached = path;
+    cached += ".comp";
+    const auto [file, macro] = splitVariant(path);
+    vector<string> macros = {"COMPUTE"};
+    if (!macro.empty())
+        macros.push_back(macro);
+
+    // The entry point uses the functions of the source, which hides its own
+    // main() if COMPUTE is defined. The line numbers of errors in the entry
+    // point start at 1 again.
+    const string source =
+        cache.getSource(file) + "\n#line 1\n" + cache.getSource(entry);
+    const uint64_t hash =
+        shaderHash(shaderc_glsl_compute_shader, file, source, true, macros);
+
+    auto spv = cache.getCompiled(cached, hash);
+    if (spv.has_value()) {
+        return std::move(spv.value());
     }
-}
\ No newline at end of file
+
+    auto spirv = compile_file(file.string(), shaderc_glsl_compute_shader,
+                              source, true, macros);
+    if (!spirv.size()) {
+        return {};
+    }
+
+    cache.store(cached, hash, spirv);
+    return spirv;
+}
+
+// Threads that help precompileShaders. Every pipeline precompiles its
+// shaders, so they are started once and shared instead of per call.
+class CompilePool {
+  public:
+    static CompilePool &get() {
+        // Never destroyed: the threads are detached, and joining them in a
+        // static destructor of the library could hang while it is unloaded.
+        static CompilePool *pool = new CompilePool();
+        return *pool;
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        available.notify_one();
+    }
+
+    // the caller of precompileShaders works as well
+    const size_t threads;
+
+  private:
+    CompilePool()
+        : threads(std::max(1u, std::thread::hardware_concurrency()) - 1) {
+        for (size_t i = 0; i < threads; i++) {
+            std::thread([this]() { work(); }).detach();
+        }
+    }
+
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this]() { return !tasks.empty(); });
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::function<void()>> tasks;
+};
+
+void precompileShaders(const vector<ShaderFile> &shaders) {
+    // A helper may only start after this call returned, e.g. if the pool is
+    // busy with the shaders of another pipeline. It then finds nothing left
+    // and never touches shaders.
+    struct Batch {
+        const vector<ShaderFile> &shaders;
+        const size_t size;
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    // not make_shared, the mutex can't be moved into it
+    const std::shared_ptr<Batch> batch(new Batch{shaders, shaders.size()});
+
+    const auto work = [batch]() {
+        for (size_t i; (i = batch->next++) < batch->size;) {
+            try {
+                compileShaderFromFile(batch->shaders[i].source,
+                                      batch->shaders[i].isVertex);
+            } catch (const std::exception &e) {
+                // reported again when the shader is actually needed
+                std::cerr << e.what() << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (++batch->done == batch->size)
+                batch->finished.notify_all();
+        }
+    };
+
+    CompilePool &pool = CompilePool::get();
+    const size_t helpers =
+        std::min(pool.threads, shaders.empty() ? 0 : shaders.size() - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        pool.post(work);
+    }
+    // this thread works as well
+    work();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock,
+                         [&]() { return batch->done == batch->size; });
+}
@@ -32,37 +32,66 @@ ShaderCache cache;
 
 ShaderCache::ShaderCache() { createFatouDB(); }
 
-/*
-optional<vector<uint32_t>> ShaderCache::getCompiled(const string &path) {
-    optional<vector<uint32_t>> spv;
-    if (fatouDB->fileExists((path + ".spv").c_str())) {
-        spv = fatouDB->getFile32((path + ".spv").c_str());
-        // readFile<uint32_t>(path + ".spv");
-        return spv;
+// the hash takes two words in front of the SPIR-V
+static constexpr size_t headerWords = 2;
+
+optional<vector<uint32_t>> ShaderCache::getCompiled(const path &p,
+                                                   uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto it = compiled.find(hash);
+    if (it != compiled.end()) {
+        return it->second;
     }
-    return spv;
-}*/
 
-optional<vector<uint8_t>> ShaderCache::getCompiled(const path &p) {
-    optional<vector<uint8_t>> spv;
     const path p2 = p.string() + ".spv";
-    if (fatouDB->fileExists(p2)) {
-        spv = fatouDB->getFile(p2);
-        // readFile<uint32_t>(path + ".spv");
-        return spv;
+    // read right from the asset pack if possible
+    vector<uint8_t> file;
+    optional<AssetView> view = fatouDB->view(p2);
+    if (!view.has_value()) {
+        if (!fatouDB->fileExists(p2)) {
+            return {};
+        }
+        file = fatouDB->getFile(p2);
+        view = AssetView{file.data(), file.size()};
     }
+
+    if (view->size % sizeof(uint32_t) != 0 ||
+        view->size <= headerWords * sizeof(uint32_t)) {
+        return {};
+    }
+    uint64_t stored;
+    memcpy(&stored, view->data, sizeof(stored));
+    if (stored != hash) {
+        // compiled from another version of the source
+        return {};
+    }
+
+    vector<uint32_t> spv((view->size / sizeof(uint32_t)) - headerWords);
+    memcpy(spv.data(), view->data + headerWords * sizeof(uint32_t),
+           spv.size() * sizeof(uint32_t));
+    compiled[hash] = spv;
     return spv;
 }
 
 string ShaderCache::getSource(const path &path) {
+    std::lock_guard<std::mutex> lock(mutex);
     auto buf = fatouDB->getFile(path); // readFile<char>(path);
     return string(buf.begin(), buf.end());
 }
 
-void ShaderCache::store(const path &path, const vector<uint32_t> &data) {
-    fatouDB->storeFile(path.string() + ".spv", data);
+bool ShaderCache::exists(const path &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fatouDB->fileExists(path);
 }
 
-void ShaderCache::store(const path &path, const vector<uint8_t> &data) {
-    fatouDB->storeFile(path.string() + ".spv", data);
+void ShaderCache::store(const path &path, uint64_t hash,
+                        const vector<uint32_t> &data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    compiled[hash] = data;
+
+    vector<uint32_t> file(headerWords);
+    memcpy(file.data(), &hash, sizeof(hash));
+    file.insert(file.end(), data.begin(), data.end());
+    fatouDB->storeFile(path.string() + ".spv", file);
 }
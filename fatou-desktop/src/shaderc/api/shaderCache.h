@@ -1,15 +1,23 @@
-
 #pragma once
 
+// SPIR-V of the shaders, stored in fatouDB next to their sources as
+// <path>.spv. Entries start with the hash of everything the compilation
+// depends on (see shaderHash) and are only used if it matches, so edited
+// shaders are compiled again. Everything loaded or compiled in this run also
+// stays in memory. All methods may be called from several threads.
 class ShaderCache {
   public:
     ShaderCache();
 
-    //   optional<vector<uint32_t>> getCompiled(const string &path);
-    optional<vector<uint8_t>> getCompiled(const path &path);
+    optional<vector<uint32_t>> getCompiled(const path &path, uint64_t hash);
     string getSource(const path &path);
-    void store(const path &path, const vector<uint32_t> &data);
-    void store(const path &path, const vector<uint8_t> &data);
+    bool exists(const path &path);
+    void store(const path &path, uint64_t hash, const vector<uint32_t> &data);
+
+  private:
+    // fatouDB is not thread-safe
+    std::mutex mutex;
+    std::map<uint64_t, vector<uint32_t>> compiled;
 };
 
-extern ShaderCache cache;
\ No newline at end of file
+extern ShaderCache cache;
@@ -0,0 +1,83 @@
+#include "../include/fatou-shaderc.h"
+
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <iostream>
+
+#include "../database.h"
+
+// Polls the modification times of the files in the shader directory. Watching
+// the directory with the OS would notice edits sooner, but editors save in
+// all kinds of ways (temporary files, renames), and a few hundred stat calls
+// twice a second are nothing.
+class ShaderWatcher : private boost::noncopyable {
+  public:
+    ShaderWatcher(const fs::path &directory) : directory(directory) {
+        times = scan();
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~ShaderWatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeUp.notify_one();
+        thread.join();
+    }
+
+    uint64_t generation() const { return changes; }
+
+  private:
+    using Times = std::map<fs::path, fs::file_time_type>;
+
+    Times scan() const {
+        Times result;
+        std::error_code error;
+        for (fs::recursive_directory_iterator it(directory, error), end;
+             !error && it != end; it.increment(error)) {
+            // the SPIR-V is stored next to the sources, see ShaderCache
+            if (!it->is_regular_file(error) ||
+                it->path().extension() == ".spv")
+                continue;
+            result[it->path()] = it->last_write_time(error);
+        }
+        return result;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeUp.wait_for(lock, interval, [this]() { return stop; })) {
+            Times now = scan();
+            if (now != times) {
+                std::cout << "Shaders changed, reloading" << std::endl;
+                times = std::move(now);
+                changes++;
+            }
+        }
+    }
+
+    const fs::path directory;
+    Times times;
+    std::atomic<uint64_t> changes{0};
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stop = false;
+
+    static constexpr std::chrono::milliseconds interval{500};
+};
+
+uint64_t shaderGeneration() {
+    static const unique_ptr<ShaderWatcher> watcher =
+        []() -> unique_ptr<ShaderWatcher> {
+        createFatouDB();
+        const auto local = fatouDB->localDirectory();
+        if (!local.has_value())
+            return nullptr;
+        return make_unique<ShaderWatcher>(local.value() / "shaders");
+    }();
+    return watcher ? watcher->generation() : 0;
+}
@@ -0,0 +1,237 @@
+#include "assetPack.h"
+
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include <blosc/blosc.h>
+#include <brotli/encode.h>
+#include <brotli/decode.h>
+
+namespace fs = std::filesystem;
+
+struct AssetPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+};
+
+struct AssetPackEntry {
+    // offsets from the start of the file
+    uint64_t nameOffset;
+    uint64_t dataOffset;
+    // bytes in the file and after decompressing
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t nameLength;
+    AssetCodec codec;
+};
+
+static constexpr char packMagic[4] = {'F', 'P', 'A', 'K'};
+
+AssetPack::AssetPack(const path &p)
+    : file(p.string().c_str(), boost::interprocess::read_only),
+      region(file, boost::interprocess::read_only) {
+    base = static_cast<const uint8_t *>(region.get_address());
+    length = region.get_size();
+
+    AssetPackHeader header;
+    if (length < sizeof(header))
+        throw runtime_error("asset pack too small");
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, packMagic, sizeof(packMagic)) != 0 ||
+        header.version != version)
+        throw runtime_error("not an asset pack of version " +
+                            to_string(version));
+
+    count = size_t(header.count);
+    if (count > (length - sizeof(header)) / sizeof(AssetPackEntry))
+        throw runtime_error("asset pack index truncated");
+    entries = reinterpret_cast<const AssetPackEntry *>(base + sizeof(header));
+
+    for (size_t i = 0; i < count; i++) {
+        const AssetPackEntry &e = entries[i];
+        if (e.nameOffset + e.nameLength > length ||
+            e.dataOffset + e.storedSize > length)
+            throw runtime_error("asset pack entry out of bounds");
+    }
+}
+
+const AssetPackEntry *AssetPack::find(const path &p) const {
+    const string name = assetName(p);
+    const auto nameOf = [this](const AssetPackEntry &e) {
+        return std::string_view(
+            reinterpret_cast<const char *>(base + e.nameOffset),
+            e.nameLength);
+    };
+
+    const AssetPackEntry *end = entries + count;
+    const AssetPackEntry *it = std::lower_bound(
+        entries, end, name, [&](const AssetPackEntry &e, const string &n) {
+            return nameOf(e) < n;
+        });
+    if (it == end || nameOf(*it) != name)
+        return nullptr;
+    return it;
+}
+
+optional<size_t> AssetPack::size(const path &name) const {
+    const AssetPackEntry *e = find(name);
+    if (!e)
+        return {};
+    return size_t(e->size);
+}
+
+optional<AssetView> AssetPack::view(const path &name,
+                                   AssetCodec codec) const {
+    const AssetPackEntry *e = find(name);
+    if (!e || e->codec != codec)
+        return {};
+    return AssetView{base + e->dataOffset, size_t(e->storedSize)};
+}
+
+bool AssetPack::read(const path &name, uint8_t *out) const {
+    const AssetPackEntry *e = find(name);
+    if (!e)
+        return false;
+    const uint8_t *data = base + e->dataOffset;
+
+    switch (e->codec) {
+    case AssetCodec::eNone:
+        memcpy(out, data, e->size);
+        return true;
+    case AssetCodec::eBlosc:
+        // the context version doesn't touch the global state of blosc
+        return blosc_decompress_ctx(data, out, e->size, 1) == int(e->size);
+    case AssetCodec::eBrotli: {
+        size_t decoded = e->size;
+        return BrotliDecoderDecompress(e->storedSize, data, &decoded, out) ==
+                   BROTLI_DECODER_RESULT_SUCCESS &&
+               decoded == e->size;
+    }
+    default:
+        return false;
+    }
+}
+
+optional<vector<uint8_t>> AssetPack::get(const path &name) const {
+    const auto n = size(name);
+    if (!n.has_value())
+        return {};
+    vector<uint8_t> data(n.value());
+    if (!read(name, data.data()))
+        throw runtime_error("broken asset " + assetName(name));
+    return data;
+}
+
+// Stores content the same way DatabaseManager::storeFile does, but with the
+// best brotli quality, as packing happens only once
+static AssetCodec compress(const vector<uint8_t> &content,
+                           vector<uint8_t> &stored) {
+    vector<uint8_t> blosc(content.size() + BLOSC_MAX_OVERHEAD);
+    const int bloscSize = blosc_compress_ctx(
+        5, 1, sizeof(uint8_t), content.size(), content.data(), blosc.data(),
+        blosc.size(), "lz4hc", 0, 1);
+    blosc.resize(std::max(bloscSize, 0));
+
+    vector<uint8_t> brotli;
+    for (const auto mode :
+         {BROTLI_MODE_GENERIC, BROTLI_MODE_TEXT, BROTLI_MODE_FONT}) {
+        vector<uint8_t> output(BrotliEncoderMaxCompressedSize(content.size()));
+        size_t encodedSize = output.size();
+        if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                                   mode, content.size(), content.data(),
+                                   &encodedSize, output.data()))
+            continue;
+        output.resize(encodedSize);
+        if (brotli.empty() || output.size() < brotli.size())
+            brotli = std::move(output);
+    }
+
+    const auto worthIt = [&](const vector<uint8_t> &c) {
+        return !c.empty() && c.size() / float(content.size()) < 0.95;
+    };
+    // blosc decompresses faster, so it wins a tie
+    if (worthIt(blosc) && (brotli.empty() || blosc.size() <= brotli.size())) {
+        stored = std::move(blosc);
+        return AssetCodec::eBlosc;
+    }
+    if (worthIt(brotli)) {
+        stored = std::move(brotli);
+        return AssetCodec::eBrotli;
+    }
+    stored = content;
+    return AssetCodec::eNone;
+}
+
+void writeAssetPack(const path &directory, const path &file) {
+    std::map<string, path> files;
+    for (const auto &entry : fs::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            files[assetName(fs::relative(entry.path(), directory))] =
+                entry.path();
+        }
+    }
+
+    // names and data follow the index
+    vector<AssetPackEntry> entries(files.size());
+    uint64_t offset =
+        sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry);
+    size_t i = 0;
+    for (const auto &[name, p] : files) {
+        entries[i].nameOffset = offset;
+        entries[i].nameLength = uint32_t(name.size());
+        offset += name.size();
+        i++;
+    }
+
+    const auto align = [](uint64_t o) {
+        return (o + AssetPack::dataAlignment - 1) /
+               AssetPack::dataAlignment * AssetPack::dataAlignment;
+    };
+
+    vector<vector<uint8_t>> stored(files.size());
+    uint64_t total = 0;
+    i = 0;
+    for (const auto &[name, p] : files) {
+        std::ifstream in(p, std::ios::binary);
+        const vector<uint8_t> content((std::istreambuf_iterator<char>(in)),
+                                      std::istreambuf_iterator<char>());
+        if (!in.good() && !in.eof())
+            throw runtime_error("couldn't read " + p.string());
+
+        entries[i].codec = compress(content, stored[i]);
+        entries[i].size = content.size();
+        entries[i].storedSize = stored[i].size();
+        offset = align(offset);
+        entries[i].dataOffset = offset;
+        offset += stored[i].size();
+        total += content.size();
+
+        std::cout << name << ": " << content.size() << " -> "
+                  << stored[i].size() << std::endl;
+        i++;
+    }
+
+    std::ofstream out(file, std::ios::binary);
+    AssetPackHeader header{};
+    memcpy(header.magic, packMagic, sizeof(packMagic));
+    header.version = AssetPack::version;
+    header.count = entries.size();
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)entries.data(),
+              entries.size() * sizeof(AssetPackEntry));
+    for (const auto &[name, p] : files)
+        out.write(name.data(), name.size());
+    for (i = 0; i < entries.size(); i++) {
+        const uint64_t padding = entries[i].dataOffset - uint64_t(out.tellp());
+        const char zeros[AssetPack::dataAlignment] = {};
+        out.write(zeros, padding);
+        out.write((const char *)stored[i].data(), stored[i].size());
+    }
+    if (!out.good())
+        throw runtime_error("couldn't write " + file.string());
+
+    std::cout << "Packed " << entries.size() << " files, " << total
+              << " bytes into " << offset << " bytes" << std::endl;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// How an entry of an AssetPack is stored
+enum class AssetCodec : uint32_t { eNone, eBlosc, eBrotli };
+
+// Bytes of an asset inside the mapping of an AssetPack
+struct AssetView {
+    const uint8_t *data;
+    size_t size;
+};
+
+struct AssetPackEntry;
+
+// Name of an asset in a pack or the database: relative to the resource
+// directory, with forward slashes
+inline string assetName(const path &p) {
+    string name = p.generic_string();
+    std::replace(name.begin(), name.end(), '\\', '/');
+    return name;
+}
+
+// Read-only archive of the resources, built by fatou-pack (see
+// writeAssetPack). The file is mapped into memory, so looking up an asset is
+// a binary search over the sorted index and uncompressed assets are used
+// right from the mapping. All methods may be called from several threads.
+//
+// Layout, all integers little endian:
+//
+//   AssetPackHeader
+//   AssetPackEntry[count], sorted by name
+//   names, not terminated
+//   data of the entries, each aligned to dataAlignment
+class AssetPack : private boost::noncopyable {
+  public:
+    // throws if file isn't a pack of this version
+    AssetPack(const path &file);
+
+    bool contains(const path &name) const { return find(name) != nullptr; }
+
+    // size of the asset after decompressing it
+    optional<size_t> size(const path &name) const;
+
+    // the asset inside the mapping, only if it is stored uncompressed
+    optional<AssetView> view(const path &name) const {
+        return view(name, AssetCodec::eNone);
+    }
+
+    // The asset inside the mapping as it is stored, only if it is stored
+    // with codec
+    optional<AssetView> view(const path &name, AssetCodec codec) const;
+
+    // Decompresses the asset straight into out, which has room for
+    // size(name) bytes. Returns false if it is not in the pack or broken.
+    bool read(const path &name, uint8_t *out) const;
+
+    optional<vector<uint8_t>> get(const path &name) const;
+
+    static constexpr uint32_t version = 1;
+    static constexpr size_t dataAlignment = 16;
+
+  private:
+    const AssetPackEntry *find(const path &name) const;
+
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const uint8_t *base = nullptr;
+    size_t length = 0;
+    const AssetPackEntry *entries = nullptr;
+    size_t count = 0;
+};
+
+// Packs all files below directory into file. Every asset is compressed with
+// blosc or brotli if that saves at least 5%, like in the database.
+void writeAssetPack(const path &directory, const path &file);
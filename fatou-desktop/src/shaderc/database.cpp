@@ -4,14 +4,14 @@
 #include <shlobj_core.h>
 
 #include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <boost/regex.hpp>
 #include "../window/console.h"
 
 unique_ptr<DatabaseManager> fatouDB = nullptr;
 
-const int BLOSC_BUFFER_SIZE = 1024 * 1024 * 10;
-static uint8_t BLOSC_BUFFER[BLOSC_BUFFER_SIZE];
-
 #define USE_LOCAL_FILES true
 
 path getIncPath() {
@@ -19,7 +19,7 @@ path getIncPath() {
                                        "C:/code/clouds/public"};
 
     for (const path p : tryme) {
-        if (fs::exists(p / "shaders/playground/mandeld.frag")) {
+        if (fs::exists(p / "shaders/playground/mandel.frag")) {
             return p;
         }
     }
@@ -27,6 +27,125 @@ path getIncPath() {
     fatalBox("Couldn't find resources!");
 }
 
+// A file the way it is stored in the FILES table: UNCOMPRESSED is the size for
+// blosc, minus the size for brotli and 0 for uncompressed data. HASH tells
+// sync() whether the file changed. RUNTIME is 1 for the files written with
+// storeFile, e.g. caches, and 0 for the resources sync() imported.
+struct StoredFile {
+    int uncompressed;
+    vector<uint8_t> data;
+    int64_t hash;
+};
+
+// FNV-1a, just to notice changes
+static int64_t contentHash(const vector<uint8_t> &content) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const uint8_t b : content) {
+        hash = (hash ^ b) * 0x100000001b3ull;
+    }
+    return int64_t(hash);
+}
+
+// Picks the smaller of blosc and the best brotli mode, if it saves at least
+// 5%. Only uses its own buffers, so it may run on several threads.
+static StoredFile compressFile(const vector<uint8_t> &content) {
+    const int64_t hash = contentHash(content);
+
+    vector<uint8_t> blosc(content.size() + BLOSC_MAX_OVERHEAD);
+    const int csize = blosc_compress_ctx(5, 1, sizeof(uint8_t), content.size(),
+                                         content.data(), blosc.data(),
+                                         blosc.size(), "lz4hc", 0, 1);
+    if (csize < 0) {
+        printf("Compression error.  Error code: %d\n", csize);
+        return {0, content, hash};
+    }
+    blosc.resize(csize);
+
+    Brotli brotli;
+    auto res = brotli.bestCompress(content);
+
+    if (csize <= res.size() && csize / float(content.size()) < 0.95) {
+        return {int(content.size()), std::move(blosc), hash};
+    } else if (res.size() <= csize &&
+               res.size() / float(content.size()) < 0.95) {
+        return {-int(content.size()), std::move(res), hash};
+    }
+    return {0, content, hash};
+}
+
+static void exec(sqlite3 *db, const char *sql) {
+    char *zErrMsg = 0;
+    if (sqlite3_exec(db, sql, nullptr, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "TODO: SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+    }
+}
+
+// The schema and the journal mode belong to the file, so only the first
+// connection sets them up
+static void createSchema(sqlite3 *db) {
+    // Readers don't wait for the writer in WAL mode. Writers still wait for
+    // each other, e.g. the shader cache and the pipeline cache.
+    exec(db, "PRAGMA journal_mode=WAL;");
+
+    exec(db, "CREATE TABLE IF NOT EXISTS FILES("
+             "ID INTEGER PRIMARY KEY AUTOINCREMENT     NOT NULL,"
+             "NAME           TEXT                      NOT NULL,"
+             "UNCOMPRESSED   INT                       NOT NULL,"
+             "DATA           BLOB                      NOT NULL,"
+             "HASH           INT             DEFAULT 0 NOT NULL,"
+             "RUNTIME        INT             DEFAULT 0 NOT NULL);"
+             "CREATE UNIQUE INDEX IF NOT EXISTS idx_files_name ON FILES "
+             "(NAME);");
+    // databases from before sync()
+    if (sqlite3_table_column_metadata(db, nullptr, "FILES", "HASH", nullptr,
+                                      nullptr, nullptr, nullptr,
+                                      nullptr) != SQLITE_OK) {
+        exec(db, "ALTER TABLE FILES ADD COLUMN HASH INT DEFAULT 0 NOT NULL;");
+    }
+    // Databases from before the pack. Their caches count as resources, so
+    // the pack wins and they are written again when needed.
+    if (sqlite3_table_column_metadata(db, nullptr, "FILES", "RUNTIME",
+                                      nullptr, nullptr, nullptr, nullptr,
+                                      nullptr) != SQLITE_OK) {
+        exec(db,
+             "ALTER TABLE FILES ADD COLUMN RUNTIME INT DEFAULT 0 NOT NULL;");
+    }
+}
+
+DatabaseConnection::DatabaseConnection(const fs::path &file, bool first) {
+    // each connection is only used by one thread at a time
+    if (sqlite3_open_v2(file.string().c_str(), &db,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                            SQLITE_OPEN_NOMUTEX,
+                        nullptr)) {
+        // TODO
+        std::cerr << "Can't open database: \n"
+                  << sqlite3_errmsg(db) << std::endl;
+        fatalBox("TODO: Can't open database!");
+    }
+
+    if (first)
+        createSchema(db);
+    // these are per connection
+    exec(db, "PRAGMA synchronous=NORMAL;");
+    sqlite3_busy_timeout(db, 5000);
+
+    stmtStore = std::make_unique<DatabaseStatement>(
+        db, "INSERT OR REPLACE INTO FILES "
+            "(NAME, UNCOMPRESSED, DATA, HASH, RUNTIME) VALUES (?,?,?,?,?);");
+    stmtFile = std::make_unique<DatabaseStatement>(
+        db, "SELECT DATA, UNCOMPRESSED from FILES where NAME = ?");
+}
+
+DatabaseConnection::~DatabaseConnection() {
+    // statements first, the connection can't close while they exist
+    stmtFile.reset();
+    stmtStore.reset();
+    if (db)
+        sqlite3_close(db);
+}
+
 DatabaseManager::DatabaseManager() {
     blosc_init();
     // zstd = very slow, strongest compression
@@ -37,7 +156,10 @@ DatabaseManager::DatabaseManager() {
     blosc_set_nthreads(4);
 
     const fs::path path = getAppData();
-    const fs::path dbPath = path / "db";
+    dbPath = path / "db";
+#if !USE_LOCAL_FILES && defined(NDEBUG)
+    const bool fresh = !fs::exists(dbPath);
+#endif
 
     // create if it doesn't exist
     if (!fs::is_directory(path) || !fs::exists(path)) {
@@ -45,27 +167,64 @@ DatabaseManager::DatabaseManager() {
     }
 
 #if !USE_LOCAL_FILES
-    bool recreate = false || !fs::exists(dbPath);
-#ifndef NDEBUG
-    if (recreate && fs::exists(dbPath)) {
-        std::uintmax_t n = fs::remove(dbPath);
+    // the others are opened on demand, see withConnection
+    idle.push_back(make_unique<DatabaseConnection>(dbPath, true));
+    connections = 1;
+
+    // not the working directory, the app may be started from anywhere
+    const fs::path packPath = executableDirectory() / "assets.pack";
+    if (fs::exists(packPath)) {
+        try {
+            pack = make_unique<AssetPack>(packPath);
+        } catch (const std::exception &e) {
+            // the resources are imported into the database instead
+            std::cerr << "Ignoring " << packPath << ": " << e.what()
+                      << std::endl;
+        }
     }
-#endif
 
-    if (sqlite3_open_v2(dbPath.string().c_str(), &db,
-                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr)) {
-        // TODO
-        std::cerr << "Can't open database: \n"
-                  << sqlite3_errmsg(db) << std::endl;
-        fatalBox("TODO: Can't open database!");
-        db = nullptr;
-        return;
+    // Only the files written at runtime shadow the pack, the resources in
+    // the database are older copies of what it ships
+    const vector<string> names =
+        withConnection([](DatabaseConnection &c) {
+            DatabaseStatement names(c.db,
+                                    "SELECT NAME FROM FILES WHERE RUNTIME = 1");
+            return names.allStrings(0);
+        });
+    stored.insert(names.begin(), names.end());
+
+    if (pack) {
+        // An install with the pack has no resource directory to sync with
+        for (const string &name : stored) {
+            if (pack->contains(name))
+                std::cerr << "The database shadows " << name
+                          << " in the pack" << std::endl;
+        }
+    } else {
+#ifdef NDEBUG
+        if (fresh)
+            sync();
+#else
+        // only compresses the files that were edited
+        sync();
+#endif
     }
+#endif
+}
 
-    if (recreate)
-        this->recreate();
+const AssetPack *DatabaseManager::packWith(const path &filename) {
+    if (!pack || !pack->contains(filename))
+        return nullptr;
+    std::lock_guard<std::mutex> lock(storedMutex);
+    return stored.count(assetName(filename)) ? nullptr : pack.get();
+}
 
-    createStmts();
+optional<AssetView> DatabaseManager::view(const path &filename) {
+#if (USE_LOCAL_FILES)
+    return {};
+#else
+    const AssetPack *p = packWith(filename);
+    return p ? p->view(filename) : std::nullopt;
 #endif
 }
 
@@ -75,25 +234,35 @@ vector<uint8_t> DatabaseManager::getFile(const path &filename) {
     const path incPath = getIncPath();
     return readFile2<uint8_t>((incPath / filename).string());
 #else
-    SQLiteMutex _(db);
-
-    stmtFile->bind(1, filename.string());
-    stmtFile->exe();
-    auto blob = stmtFile->blob(0);
-    int uncompressed = stmtFile->integer(1);
-    stmtFile->reset();
-
+    if (const AssetPack *p = packWith(filename))
+        return p->get(filename).value();
+
+    const string name = assetName(filename);
+    auto [blob, uncompressed] = withConnection([&](DatabaseConnection &c) {
+        DatabaseStatement &stmtFile = *c.stmtFile;
+        stmtFile.bind(1, name);
+        stmtFile.exe();
+        auto result = std::make_pair(stmtFile.blob(0), stmtFile.integer(1));
+        stmtFile.reset();
+        return result;
+    });
+
+    // decompressed after the connection is returned
     if (uncompressed > 0) {
+        // straight into the result, the header of blosc has the size
+        size_t nbytes, cbytes, blocksize;
+        blosc_cbuffer_sizes(blob.data(), &nbytes, &cbytes, &blocksize);
+        vector<uint8_t> data(nbytes);
         int dsize =
-            blosc_decompress(blob.data(), BLOSC_BUFFER, BLOSC_BUFFER_SIZE);
+            blosc_decompress_ctx(blob.data(), data.data(), data.size(), 1);
         if (dsize < 0) {
             printf("Decompression error.  Error code: %d\n", dsize);
             return {};
         }
-        return vector<uint8_t>(BLOSC_BUFFER, BLOSC_BUFFER + dsize);
+        return data;
     } else if (uncompressed < 0) {
-        const auto res = debrotli.decompress(blob, -uncompressed);
-        return res;
+        Debrotli debrotli;
+        return debrotli.decompress(blob, -uncompressed);
     } else {
         return blob;
     }
@@ -105,11 +274,26 @@ bool DatabaseManager::fileExists(const path &filename) {
     const path incPath = getIncPath();
     return fs::exists(incPath / filename);
 #else
-    stmtFile->bind(1, filename.string());
-    bool found = stmtFile->tryExe();
-    int size = stmtFile->integer(1);
-    stmtFile->reset();
-    return size != 0;
+    if (packWith(filename))
+        return true;
+
+    const string name = assetName(filename);
+    return withConnection([&](DatabaseConnection &c) {
+        DatabaseStatement &stmtFile = *c.stmtFile;
+        stmtFile.bind(1, name);
+        bool found = stmtFile.tryExe();
+        int size = stmtFile.integer(1);
+        stmtFile.reset();
+        return size != 0;
+    });
+#endif
+}
+
+optional<fs::path> DatabaseManager::localDirectory() const {
+#if (USE_LOCAL_FILES)
+    return getIncPath();
+#else
+    return {};
 #endif
 }
 
@@ -122,45 +306,35 @@ void DatabaseManager::storeFile(const path &name,
     file.write((char *)content.data(), content.size() * sizeof(uint8_t));
     file.close();
 #else
-    SQLiteMutex _(db);
-
-    string filename = name.string();
-    std::replace(filename.begin(), filename.end(), '\\', '/');
-
-    if (content.size() >= BLOSC_BUFFER_SIZE) {
-        fatalBox("blosc buffer too small!");
-    }
+    const string filename = assetName(name);
+    const StoredFile f = compressFile(content);
+
+    withConnection([&](DatabaseConnection &c) {
+        DatabaseStatement &stmtStore = *c.stmtStore;
+        stmtStore.bind(1, filename);
+        stmtStore.bind(2, f.uncompressed);
+        stmtStore.bind(3, (const void *)f.data.data(), f.data.size());
+        stmtStore.bind64(4, f.hash);
+        stmtStore.bind(5, 1);
+        stmtStore.exe();
+        stmtStore.reset();
+    });
+
+    std::lock_guard<std::mutex> lock(storedMutex);
+    stored.insert(filename);
+#endif
+}
 
-    int csize = blosc_compress(5, 1, sizeof(uint8_t), content.size(),
-                               content.data(), BLOSC_BUFFER, BLOSC_BUFFER_SIZE);
-    if (csize < 0) {
-        printf("Compression error.  Error code: %d\n", csize);
-        return;
+fs::path DatabaseManager::executableDirectory() {
+    TCHAR szPath[MAX_PATH];
+    const DWORD n = GetModuleFileName(NULL, szPath, MAX_PATH);
+    if (n > 0 && n < MAX_PATH) {
+        return fs::path(szPath).parent_path();
     }
 
-    const auto res = brotli.bestCompress(content);
-    std::cout << res.size() / float(csize) << " "
-              << res.size() / float(content.size()) << " " << filename
-              << std::endl;
-
-    // std::cout << csize / float(content.size()) << " " << filename <<
-    // std::endl;
-
-    stmtStore->bind(1, filename);
-    if (csize <= res.size() && csize / float(content.size()) < 0.95) {
-        stmtStore->bind(2, content.size());
-        stmtStore->bind(3, (const void *)BLOSC_BUFFER, csize);
-    } else if (res.size() <= csize &&
-               res.size() / float(content.size()) < 0.95) {
-        stmtStore->bind(2, -content.size());
-        stmtStore->bind(3, (const void *)res.data(), res.size());
-    } else {
-        stmtStore->bind(2, 0);
-        stmtStore->bind(3, (const void *)content.data(), content.size());
-    }
-    stmtStore->exe();
-    stmtStore->reset();
-#endif
+    std::cerr << "Can't find the executable, looking for the pack in "
+              << fs::current_path() << std::endl;
+    return fs::current_path();
 }
 
 fs::path DatabaseManager::getAppData() {
@@ -175,57 +349,83 @@ fs::path DatabaseManager::getAppData() {
     return fs::current_path();
 }
 
-void DatabaseManager::recreate() {
-
-#ifndef NDEBUG
+void DatabaseManager::sync() {
 #if !USE_LOCAL_FILES
-
-    {
-        SQLiteMutex _(db);
-
-        const char *sql = "CREATE TABLE FILES("
-                          "ID INTEGER PRIMARY KEY AUTOINCREMENT     NOT NULL,"
-                          "NAME           TEXT                      NOT NULL,"
-                          "UNCOMPRESSED   INT                       NOT NULL,"
-                          "DATA           BLOB                      NOT NULL);"
-                          "CREATE UNIQUE INDEX idx_files_name ON FILES (NAME);";
-
-        char *zErrMsg = 0;
-        if (sqlite3_exec(db, sql, nullptr, 0, &zErrMsg) != SQLITE_OK) {
-            fprintf(stderr, "TODO: SQL error: %s\n", zErrMsg);
-            sqlite3_free(zErrMsg);
-        }
-
-        sqlite3_exec(db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
-    }
-    createStmts();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::map<string, int64_t> hashes =
+        withConnection([](DatabaseConnection &c) {
+            DatabaseStatement stmt(c.db, "SELECT NAME, HASH FROM FILES");
+            std::map<string, int64_t> result;
+            while (sqlite3_step(stmt.stmt) == SQLITE_ROW) {
+                result[stmt.text(0)] = stmt.integer64(1);
+            }
+            return result;
+        });
+
+    struct Resource {
+        string name;
+        fs::path file;
+        // only for changed files
+        optional<StoredFile> stored;
+    };
+    vector<Resource> resources;
 
     const path incPath = getIncPath();
     for (const auto &entry : fs::recursive_directory_iterator(incPath)) {
         if (fs::is_regular_file(entry)) {
-            string s = entry.path().string();
-            string s2 = s.substr(incPath.string().length() + 1);
+            resources.push_back(
+                {assetName(fs::relative(entry.path(), incPath)), entry.path()});
+        }
+    }
 
-            auto content = readFile2<uint8_t>(entry.path().string());
-            storeFile(s2, content);
+    // Reading and hashing is cheap compared to compressing, but all of it
+    // runs on all cores
+    std::atomic<size_t> next{0};
+    const auto work = [&]() {
+        for (size_t i; (i = next++) < resources.size();) {
+            Resource &r = resources[i];
+            const auto content = readFile2<uint8_t>(r.file.string());
+            const auto it = hashes.find(r.name);
+            if (it == hashes.end() || it->second != contentHash(content))
+                r.stored = compressFile(content);
         }
+    };
+    const size_t threads = std::min<size_t>(
+        resources.size(), std::thread::hardware_concurrency());
+    vector<std::thread> workers;
+    for (size_t i = 1; i < threads; i++) {
+        workers.emplace_back(work);
     }
-    {
-        SQLiteMutex _(db);
-        sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, nullptr);
+    work();
+    for (auto &worker : workers) {
+        worker.join();
     }
-#endif
-#endif
-}
-
-void DatabaseManager::createStmts() {
 
-    SQLiteMutex _(db);
-    if (!stmtStore.get())
-        stmtStore = std::make_unique<DatabaseStatement>(
-            db, "INSERT INTO FILES (NAME, UNCOMPRESSED, DATA) VALUES (?,?,?);");
+    // one transaction, otherwise every row is synced to disk
+    size_t changed = 0;
+    withConnection([&](DatabaseConnection &c) {
+        exec(c.db, "BEGIN TRANSACTION");
+        DatabaseStatement &stmtStore = *c.stmtStore;
+        for (const Resource &r : resources) {
+            if (!r.stored.has_value())
+                continue;
+            stmtStore.bind(1, r.name);
+            stmtStore.bind(2, r.stored->uncompressed);
+            stmtStore.bind(3, (const void *)r.stored->data.data(),
+                           r.stored->data.size());
+            stmtStore.bind64(4, r.stored->hash);
+            stmtStore.bind(5, 0);
+            stmtStore.exe();
+            stmtStore.reset();
+            changed++;
+        }
+        exec(c.db, "COMMIT TRANSACTION");
+    });
 
-    if (!stmtFile.get())
-        stmtFile = std::make_unique<DatabaseStatement>(
-            db, "SELECT DATA, UNCOMPRESSED from FILES where NAME = ?");
-}
\ No newline at end of file
+    const std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Synced " << changed << " of " << resources.size()
+              << " resources in " << took.count() << "s" << std::endl;
+#endif
+}
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <fstream>
+#include <condition_variable>
 
 #include <sqlite3.h>
 #include "../window/console.h"
 #include <brotli/encode.h>
 #include <brotli/decode.h>
+#include "assetPack.h"
 
 namespace fs = std::filesystem;
 
@@ -98,17 +100,6 @@ inline bool fileExists(const std::string &name) {
     return f.good();
 }
 
-class SQLiteMutex {
-  public:
-    SQLiteMutex(sqlite3 *db) : db(db) {
-        sqlite3_mutex_enter(sqlite3_db_mutex(db));
-    }
-    ~SQLiteMutex() { sqlite3_mutex_leave(sqlite3_db_mutex(db)); }
-
-  private:
-    sqlite3 *db;
-};
-
 class DatabaseStatement {
   public:
     DatabaseStatement(sqlite3 *db, const char *txt) {
@@ -132,6 +123,7 @@ class DatabaseStatement {
     }
 
     void bind(int i, int data) { sqlite3_bind_int(stmt, i, data); }
+    void bind64(int i, int64_t data) { sqlite3_bind_int64(stmt, i, data); }
 
     bool tryExe() {
         int res = sqlite3_step(stmt);
@@ -173,21 +165,36 @@ class DatabaseStatement {
     }
 
     int integer(int i) { return sqlite3_column_int(stmt, i); }
+    int64_t integer64(int i) { return sqlite3_column_int64(stmt, i); }
 
   public:
     sqlite3 *db;
     sqlite3_stmt *stmt;
 };
 
+// A connection with its own prepared statements, which one thread at a time
+// leases from the DatabaseManager. The database is in WAL mode, so readers on
+// different connections block neither each other nor the writer.
+class DatabaseConnection : private boost::noncopyable {
+  public:
+    // the first connection to file creates the tables
+    DatabaseConnection(const fs::path &file, bool first = false);
+    ~DatabaseConnection();
+
+    sqlite3 *db = nullptr;
+    unique_ptr<DatabaseStatement> stmtFile;
+    unique_ptr<DatabaseStatement> stmtStore;
+};
+
 class DatabaseManager {
   public:
     DatabaseManager();
 
-    void createStmts();
-
     bool fileExists(const path &filename);
 
     vector<uint8_t> getFile(const path &filename);
+    // the file without copying it, if it is stored uncompressed in the pack
+    optional<AssetView> view(const path &filename);
     /* vector<uint32_t> getFile32(const char* filename) {
          auto tmp = getFile(filename);
          const uint32_t* d = (const uint32_t * )tmp.data();
@@ -202,22 +209,72 @@ class DatabaseManager {
                                        d + (content.size() * sizeof(uint32_t)));
         storeFile(name, content2);
     }
-    void recreate();
+    // Brings the database up to date with the resource directory. Only the
+    // files whose content changed are compressed again, on all cores.
+    void sync();
 
     fs::path getAppData();
+    // where the shipped files are installed, e.g. the pack
+    static fs::path executableDirectory();
 
-    ~DatabaseManager() {
-        if (db)
-            sqlite3_close(db);
-    }
+    // directory of the files if they are read from disk instead of the
+    // database, i.e. they can be edited while the app runs
+    optional<fs::path> localDirectory() const;
 
   private:
-    sqlite3 *db = nullptr;
-    unique_ptr<DatabaseStatement> stmtFile;
-    unique_ptr<DatabaseStatement> stmtStore;
+    // the pack if it has the file and it wasn't stored in the database since
+    const AssetPack *packWith(const path &filename);
+
+    // Runs f with a connection no other thread uses meanwhile. Connections
+    // are opened on demand and reused, up to maxConnections. Beyond that,
+    // threads wait for one to be returned.
+    template <class F> auto withConnection(F f) {
+        unique_ptr<DatabaseConnection> connection;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            returned.wait(lock, [this]() {
+                return !idle.empty() || connections < maxConnections;
+            });
+            if (!idle.empty()) {
+                connection = std::move(idle.back());
+                idle.pop_back();
+            } else {
+                connections++;
+            }
+        }
+        if (!connection)
+            connection = make_unique<DatabaseConnection>(dbPath);
+
+        // returned even if f throws
+        struct Lease {
+            DatabaseManager &manager;
+            unique_ptr<DatabaseConnection> &connection;
+            ~Lease() {
+                {
+                    std::lock_guard<std::mutex> lock(manager.poolMutex);
+                    manager.idle.push_back(std::move(connection));
+                }
+                manager.returned.notify_one();
+            }
+        } lease{*this, connection};
+        return f(*connection);
+    }
 
-    Brotli brotli;
-    Debrotli debrotli;
+    fs::path dbPath;
+    std::mutex poolMutex;
+    std::condition_variable returned;
+    vector<unique_ptr<DatabaseConnection>> idle;
+    // open ones, idle or leased
+    size_t connections = 0;
+    static constexpr size_t maxConnections = 8;
+
+    // The shipped resources (assets.pack next to the executable). If it is
+    // valid, nothing is synced from the resource directory.
+    unique_ptr<AssetPack> pack;
+    // Names written with storeFile, e.g. caches. They are in the database
+    // and take precedence over the pack, the imported resources don't.
+    std::mutex storedMutex;
+    set<string> stored;
 };
 
 extern unique_ptr<DatabaseManager> fatouDB;
@@ -10,5 +10,37 @@
 
 #define FATOULIBRARY_API
 
-FATOULIBRARY_API void *compileShaderFromFile(const path &path, bool isVertex,
-                                             size_t &len);
\ No newline at end of file
+// Shaders can be compiled in variants, e.g. mandel.frag for each arithmetic.
+// The macro of the variant is defined while compiling. It is appended to the
+// path after a '#', which the functions below understand, and also keeps the
+// variants apart in the cache.
+inline path shaderVariant(const path &source, const string &macro) {
+    return macro.empty() ? source : path(source.string() + "#" + macro);
+}
+
+// Returns the SPIR-V of the vertex or fragment shader at path, which is empty
+// if the compilation failed. #include "file" is resolved relative to the
+// shader.
+FATOULIBRARY_API vector<uint32_t> compileShaderFromFile(const path &path,
+                                                        bool isVertex);
+
+// Compiles the functions of the shader at path together with the compute
+// entry point at entry, see interlace.comp
+FATOULIBRARY_API vector<uint32_t>
+compileComputeShaderFromFile(const path &path, const path &entry);
+
+// Counts the edits of the shader sources while the app runs. Renderers
+// which have seen an older count build their pipelines again, see
+// InterlacedRenderer::reload. The sources are watched on another thread, so
+// this is cheap to call every frame. Stays 0 if the shaders are read from the
+// database.
+FATOULIBRARY_API uint64_t shaderGeneration();
+
+struct ShaderFile {
+    path source;
+    bool isVertex;
+};
+
+// Compiles the shaders on all cores. Then compileShaderFromFile finds them
+// in the cache, so constructing the pipelines one after the other is cheap.
+FATOULIBRARY_API void precompileShaders(const vector<ShaderFile> &shaders);
@@ -0,0 +1,96 @@
+// The implementation of VMA, only compiled here. It uses the Vulkan functions
+// the loader library exports.
+#define VMA_IMPLEMENTATION
+#define VMA_STATIC_VULKAN_FUNCTIONS 1
+#define VMA_DYNAMIC_VULKAN_FUNCTIONS 0
+#include <vk_mem_alloc.h>
+
+#include "allocator.h"
+#include "logicalDevice.h"
+
+void Allocation::write(const void *data, size_t size, size_t offset) {
+    if (mapped) {
+        memcpy((char *)mapped + offset, data, size);
+        return;
+    }
+
+    void *p;
+    if (vmaMapMemory(allocator, allocation, &p) != VK_SUCCESS) {
+        throw runtime_error("couldn't map memory");
+    }
+    memcpy((char *)p + offset, data, size);
+    vmaUnmapMemory(allocator, allocation);
+}
+
+void Allocation::release() {
+    if (allocation)
+        vmaFreeMemory(allocator, allocation);
+    allocation = nullptr;
+    mapped = nullptr;
+}
+
+MemoryAllocator::MemoryAllocator(LogicalDevice &device) {
+    VmaAllocatorCreateInfo createInfo{};
+    createInfo.vulkanApiVersion = VK_API_VERSION_1_0;
+    createInfo.physicalDevice = device.physical->handle();
+    createInfo.device = device.handle();
+    createInfo.instance = device.physical->getWindow()->getInstance()->get();
+
+    if (vmaCreateAllocator(&createInfo, &allocator) != VK_SUCCESS) {
+        throw runtime_error("failed to create memory allocator!");
+    }
+}
+
+MemoryAllocator::~MemoryAllocator() { vmaDestroyAllocator(allocator); }
+
+// Asks for exactly the memory properties the old allocations used
+static VmaAllocationCreateInfo
+allocationInfo(vk::MemoryPropertyFlags properties) {
+    VmaAllocationCreateInfo info{};
+    info.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    info.requiredFlags = VkMemoryPropertyFlags(properties);
+    if (properties & vk::MemoryPropertyFlagBits::eHostVisible) {
+        // saves mapping it for every update
+        info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    }
+    return info;
+}
+
+Allocation MemoryAllocator::allocate(vk::Buffer buffer,
+                                     vk::MemoryPropertyFlags properties) {
+    const VmaAllocationCreateInfo info = allocationInfo(properties);
+    VmaAllocation allocation;
+    VmaAllocationInfo result;
+    if (vmaAllocateMemoryForBuffer(allocator, buffer, &info, &allocation,
+                                   &result) != VK_SUCCESS) {
+        throw runtime_error("failed to allocate buffer memory!");
+    }
+    Allocation a(allocator, allocation, result.pMappedData);
+    if (vmaBindBufferMemory(allocator, allocation, buffer) != VK_SUCCESS) {
+        throw runtime_error("failed to bind buffer memory!");
+    }
+    return a;
+}
+
+Allocation MemoryAllocator::allocate(vk::Image image,
+                                     vk::MemoryPropertyFlags properties) {
+    const VmaAllocationCreateInfo info = allocationInfo(properties);
+    VmaAllocation allocation;
+    VmaAllocationInfo result;
+    if (vmaAllocateMemoryForImage(allocator, image, &info, &allocation,
+                                  &result) != VK_SUCCESS) {
+        throw runtime_error("failed to allocate image memory!");
+    }
+    Allocation a(allocator, allocation, result.pMappedData);
+    if (vmaBindImageMemory(allocator, allocation, image) != VK_SUCCESS) {
+        throw runtime_error("failed to bind image memory!");
+    }
+    return a;
+}
+
+MemoryStats MemoryAllocator::stats() const {
+    VmaTotalStatistics total;
+    vmaCalculateStatistics(allocator, &total);
+    const VmaStatistics &s = total.total.statistics;
+    return {s.blockCount, s.allocationCount, s.blockBytes, s.allocationBytes};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vk_mem_alloc.h>
+
+class LogicalDevice;
+
+// Memory of a buffer or an image, sub-allocated from the blocks of the
+// MemoryAllocator. Freed when destroyed, like the vk::raii objects.
+class Allocation : private boost::noncopyable {
+  public:
+    Allocation(std::nullptr_t) {}
+    Allocation(VmaAllocator allocator, VmaAllocation allocation, void *mapped)
+        : allocator(allocator), allocation(allocation), mapped(mapped) {}
+
+    Allocation(Allocation &&other) noexcept { *this = std::move(other); }
+    Allocation &operator=(Allocation &&other) noexcept {
+        if (this != &other) {
+            release();
+            allocator = std::exchange(other.allocator, nullptr);
+            allocation = std::exchange(other.allocation, nullptr);
+            mapped = std::exchange(other.mapped, nullptr);
+        }
+        return *this;
+    }
+
+    ~Allocation() { release(); }
+
+    // Copies size bytes into host visible (and coherent) memory at the given
+    // offset. Such memory stays mapped, e.g. uniform buffers are written every
+    // frame.
+    void write(const void *data, size_t size, size_t offset = 0);
+
+  private:
+    void release();
+
+    VmaAllocator allocator = nullptr;
+    VmaAllocation allocation = nullptr;
+    void *mapped = nullptr;
+};
+
+// Totals over all memory of the allocator
+struct MemoryStats {
+    // vkAllocateMemory calls, i.e. the blocks that are sub-allocated
+    uint32_t blocks;
+    uint32_t allocations;
+    uint64_t blockBytes;
+    uint64_t allocationBytes;
+};
+
+// Places all buffers and images in a few large blocks per memory type
+// (VulkanMemoryAllocator) instead of allocating memory for each of them. The
+// maximum number of allocations can be as low as 4096, and every allocation
+// is a call into the kernel.
+class MemoryAllocator : private boost::noncopyable {
+  public:
+    MemoryAllocator(LogicalDevice &device);
+    ~MemoryAllocator();
+
+    // allocates memory with the properties and binds it
+    Allocation allocate(vk::Buffer buffer, vk::MemoryPropertyFlags properties);
+    Allocation allocate(vk::Image image, vk::MemoryPropertyFlags properties);
+
+    MemoryStats stats() const;
+
+  private:
+    VmaAllocator allocator = nullptr;
+};
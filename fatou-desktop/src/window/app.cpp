@@ -14,7 +14,7 @@
 #include "console.h"
 
 #include "sharedTexture.h"
-shared_ptr<OnlineTexture> targetTexture;
+shared_ptr<GuiTexture> targetTexture;
 std::mutex targetMutex;
 
 std::unique_lock initialLock(targetMutex);
@@ -100,6 +100,17 @@ void App::recreateMandelPipe() {
                                              swapChain->getPhases());
         mandel->makeDP(*compositor);
     }
+
+    // the next start (or resize) reuses the new pipelines
+    device->savePipelineCache();
+
+    // all layers and framebuffers were just (re-)allocated
+    const MemoryStats memory = device->allocator->stats();
+    commitJS("setRenderParams",
+             "{memoryBlocks:" + jsStr(size_t(memory.blocks)) +
+                 ",memoryAllocations:" + jsStr(size_t(memory.allocations)) +
+                 ",memoryAllocated:" + jsStr(size_t(memory.blockBytes)) +
+                 ",memoryUsed:" + jsStr(size_t(memory.allocationBytes)) + "}");
 }
 
 void App::updateGUITexture() {
@@ -107,16 +118,15 @@ void App::updateGUITexture() {
     int w = swapChain->extent().width;
     int h = swapChain->extent().height;
 
-    uint8_t *data = new uint8_t[w * h * 4];
-    memset(data, 0, w * h * 4);
-    cefTexture =
-        make_shared<OnlineTexture>(device, commandPool->transfer(), w, h);
-    cefTexture->update(data);
-    delete[] data;
-    targetTexture = cefTexture;
-
-    cefDescriptorPool.reset();
-    cefDescriptorPool = compositor->makeDP(cefTexture->imageView());
+    cefTexture = make_shared<GuiTexture>(device, *compositor, w, h);
+    {
+        // OnPaint may still upload into the old one. While the App is
+        // constructed, initialLock keeps it out.
+        std::unique_lock lk(targetMutex, std::defer_lock);
+        if (!initialLock.owns_lock())
+            lk.lock();
+        targetTexture = cefTexture;
+    }
 
     if (CefModule::getInstance())
         CefModule::getInstance()->resize(w, h);
@@ -133,9 +143,6 @@ void App::recreateSwapChain() {
     win->waitWhileMinimized();
     device->waitIdle();
 
-    // TODO: already locked by mainloop. Always?
-    // std::unique_lock lk(targetMutex);
-
     compositor->setSwapchain(nullptr);
 
     // swapChain.reset();
@@ -145,8 +152,6 @@ void App::recreateSwapChain() {
     compositor->setSwapchain(swapChain);
 
     updateGUITexture();
-
-    // lk.unlock();
 }
 
 void App::maybeRecreateRenderTexture() {
@@ -162,13 +167,8 @@ void App::maybeRecreateRenderTexture() {
 
     device->waitIdle();
 
-    // TODO: already locked by mainloop. Always?
-    // std::unique_lock lk(targetMutex);
-
     // size has changed
     recreateMandelPipe();
-
-    // lk.unlock();
 }
 
 void App::renderStep() {
@@ -246,6 +246,7 @@ void App::recordCommandBuffer(vk::CommandBuffer commandBuffer,
 
         if (mandel.get()) {
             IRect r = renderAreaRect;
+            presentedRect = r;
             mandel->present(commandBuffer, *compositor, r);
         }
 
@@ -265,21 +266,54 @@ void App::recordCommandBuffer(vk::CommandBuffer commandBuffer,
         }
 
 #ifdef WITH_GUI
-        compositor->setTransform(cefDescriptorPool.get(), glm::mat4(1.0f),
-                                 true);
-        compositor->draw(commandBuffer, cefDescriptorPool.get());
+        // whatever CEF painted last, it never waits for this frame
+        DescriptorPool *gui = cefTexture->latest();
+        compositor->setTransform(gui, glm::mat4(1.0f), true);
+        compositor->draw(commandBuffer, gui);
 #endif
     }
 }
 
+bool App::needsFrame() {
+    // the loader is animated
+    if (!mandel.get())
+        return true;
+
+    const IRect r = renderAreaRect;
+    if (r.top != presentedRect.top || r.right != presentedRect.right ||
+        r.bottom != presentedRect.bottom || r.left != presentedRect.left)
+        return true;
+
+#ifdef WITH_GUI
+    if (cefTexture->painted())
+        return true;
+#endif
+
+    return mandel->needsFrame();
+}
+
 void App::mainLoop() {
     try {
         std::chrono::duration frameTime =
             std::chrono::milliseconds(1000 / 61); // 61Hz
+        // seconds between the checks while idle
+        const double idleTimeout = 0.1;
         auto nextFrame = std::chrono::system_clock::now();
         auto lastFrame = nextFrame - frameTime;
 
         while (!win->active()) {
+            win->poll();
+
+            maybeRecreateRenderTexture();
+
+            if (!framebufferResized && !needsFrame()) {
+                // Neither records nor presents. CEF paints and presets wake
+                // the loop right away (wakeMainLoop), the timeout notices
+                // edited shaders.
+                win->waitEvents(idleTimeout);
+                nextFrame = std::chrono::system_clock::now();
+                continue;
+            }
 
             static auto fpsStart = std::chrono::high_resolution_clock::now();
             static int frameCounter = 0;
@@ -300,18 +334,12 @@ void App::mainLoop() {
                 frameCounter = 0;
             }
 
-            win->poll();
-
-            std::unique_lock lk(targetMutex);
-
             // - Wait for the previous frame to finish
             // - Acquire an image from the swap chain
             // - Record a command buffer which draws the scene onto that image
             // - Submit the recorded command buffer
             // - FPresent the swap chain image
 
-            maybeRecreateRenderTexture();
-
             optional<uint32_t> imageIndex = commandPool->acquireNextImage(
                 swapChain->swapChain, framebufferResized);
             if (!imageIndex.has_value()) {
@@ -329,8 +357,6 @@ void App::mainLoop() {
             commandPool->presentFrame(swapChain->swapChain, imageIndex.value());
             commandPool->swapBuffers();
 
-            lk.unlock();
-
             std::this_thread::sleep_until(nextFrame);
             lastFrame = nextFrame;
             nextFrame += frameTime;
@@ -345,6 +371,10 @@ void App::mainLoop() {
 }
 
 App::~App() {
-    targetTexture.reset();
+    {
+        // OnPaint might be uploading into it
+        std::lock_guard<std::mutex> lock(targetMutex);
+        targetTexture.reset();
+    }
     swapChain.reset();
 }
\ No newline at end of file
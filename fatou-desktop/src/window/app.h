@@ -11,6 +11,7 @@
 #include "texture.h"
 #include "fractal.h"
 #include "compositor.h"
+#include "guiTexture.h"
 
 class App : public Pingable {
   public:
@@ -27,11 +28,10 @@ class App : public Pingable {
     shared_ptr<CommandPool> commandPool;
 
     shared_ptr<DescriptorPool> loaderDescriptorPool;
-    shared_ptr<DescriptorPool> cefDescriptorPool;
 
     shared_ptr<Compositor> compositor;
 
-    shared_ptr<OnlineTexture> cefTexture;
+    shared_ptr<GuiTexture> cefTexture;
     shared_ptr<Texture> loaderTexture;
 
     shared_ptr<Fractal_Mandel> mandel;
@@ -51,4 +51,9 @@ class App : public Pingable {
     void renderStep();
     void recreateMandelPipe();
     void maybeRecreateRenderTexture();
+
+    // false if the last presented frame still shows everything
+    bool needsFrame();
+    // render area of the last presented frame
+    IRect presentedRect = {0, 0, 0, 0};
 };
@@ -0,0 +1,91 @@
+#include "bla.h"
+
+#include <cmath>
+#include <cstring>
+
+static inline glm::dvec2 imMul(glm::dvec2 a, glm::dvec2 b) {
+    return glm::dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+static inline double magnitude(glm::dvec2 a) {
+    return std::sqrt(a.x * a.x + a.y * a.y);
+}
+
+// the quadratic term must vanish at double precision
+static const double epsilon = std::ldexp(1.0, -53);
+
+BilinearApproximation::BilinearApproximation(const vector<glm::dvec2> &orbit,
+                                             double dcMax, double radius2)
+    : dcMax(dcMax), radius2(radius2) {
+
+    // Steps must land in front of the last point of the orbit (where the
+    // shader rebases) and must not skip the iteration where the reference
+    // leaves the escape radius.
+    size_t end = orbit.empty() ? 0 : orbit.size() - 1;
+    for (size_t m = 1; m < end; m++) {
+        if (orbit[m].x * orbit[m].x + orbit[m].y * orbit[m].y > radius2) {
+            end = m;
+            break;
+        }
+    }
+
+    // single steps m -> m + 1 for m in [1, end - 1)
+    const size_t count = end >= 2 ? end - 2 : 0;
+    if (count == 0) {
+        header.levels = 0;
+        return;
+    }
+
+    steps.reserve(2 * count);
+    for (size_t m = 1; m <= count; m++) {
+        BLAStep s{};
+        s.a = 2. * orbit[m];
+        s.b = glm::dvec2(1., 0.);
+        const double r = epsilon * magnitude(s.a);
+        s.r2 = r * r;
+        steps.push_back(s);
+    }
+
+    header.levelStart[0] = 0;
+    size_t levelSize = count;
+    int k = 0;
+    while (true) {
+        header.levelStart[k + 1] = int32_t(steps.size());
+        k++;
+
+        if (levelSize < 2 || k == BLA_MAX_LEVELS)
+            break;
+
+        // merge pairs of the previous level
+        const size_t begin = header.levelStart[k - 1];
+        levelSize /= 2;
+        for (size_t i = 0; i < levelSize; i++) {
+            const BLAStep x = steps[begin + 2 * i];
+            const BLAStep y = steps[begin + 2 * i + 1];
+
+            BLAStep s{};
+            s.a = imMul(y.a, x.a);
+            s.b = imMul(y.a, x.b) + y.b;
+
+            const double ax = magnitude(x.a);
+            const double rx = std::sqrt(x.r2);
+            const double ry =
+                ax > 0 ? (std::sqrt(y.r2) - magnitude(x.b) * dcMax) / ax : 0.;
+            const double r = std::max(0., std::min(rx, ry));
+            s.r2 = r * r;
+
+            steps.push_back(s);
+        }
+    }
+    header.levels = k;
+}
+
+vector<uint8_t> BilinearApproximation::serialize() const {
+    vector<uint8_t> data(sizeof(BLAHeader) + sizeof(BLAStep) * steps.size());
+    memcpy(data.data(), &header, sizeof(BLAHeader));
+    if (!steps.empty()) {
+        memcpy(data.data() + sizeof(BLAHeader), steps.data(),
+               sizeof(BLAStep) * steps.size());
+    }
+    return data;
+}
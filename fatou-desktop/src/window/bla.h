@@ -0,0 +1,71 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/*
+Bilinear approximation (BLA) of the perturbation iteration
+
+As long as |dz| is tiny compared to |Z_m|, the quadratic term of
+
+    dz_{m+1} = 2 Z_m dz_m + dz_m^2 + dc
+
+vanishes and a step is linear in dz and dc: dz_{m+1} = A dz_m + B dc with
+A = 2 Z_m and B = 1. Two such steps can be merged into one:
+
+    A = A_y A_x, B = A_y B_x + B_y,
+    R = max(0, min(R_x, (R_y - |B_x| |dc|max) / |A_x|))
+
+where R is the radius of |dz| in which the approximation is valid. Merging
+neighbours recursively yields a table with log2(n) levels, level k containing
+steps which skip 2^k iterations. The shader walks the table from the highest
+level that is aligned with the current iteration down to the lowest one and
+takes the first step that is valid for its |dz|.
+
+See https://mathr.co.uk/web/deep-zoom.html#bilinear-approximation
+*/
+
+#define BLA_MAX_LEVELS 32
+
+// Layout (std430) of the storage buffer at binding 3 of the perturbation
+// shaders. The steps follow directly.
+struct alignas(16) BLAHeader {
+    int32_t levels;
+    // first step of each level, levelStart[levels] is the number of steps
+    int32_t levelStart[BLA_MAX_LEVELS + 1];
+};
+static_assert(sizeof(BLAHeader) == 144, "BLAHeader doesn't match std430");
+
+struct BLAStep {
+    alignas(16) glm::dvec2 a;
+    alignas(16) glm::dvec2 b;
+    // squared validity radius of |dz|
+    alignas(8) double r2;
+};
+static_assert(sizeof(BLAStep) == 48, "BLAStep doesn't match std430");
+
+class BilinearApproximation : private boost::noncopyable {
+  public:
+    // Builds the table for the reference orbit. It is valid for all pixels
+    // with |dc| <= dcMax. Steps never leave the escape radius.
+    BilinearApproximation(const vector<glm::dvec2> &orbit, double dcMax,
+                          double radius2);
+
+    // Whether the table should be used for a viewport with the given |dc|.
+    // When zooming in a lot, the table is still valid but too pessimistic.
+    bool covers(double dcMax, double radius2) const {
+        return radius2 == this->radius2 && dcMax <= this->dcMax &&
+               dcMax * 64 >= this->dcMax;
+    }
+
+    // header and steps as they are uploaded to the GPU
+    vector<uint8_t> serialize() const;
+
+    const double dcMax;
+    const double radius2;
+    int levels() const { return header.levels; }
+
+  private:
+    BLAHeader header{};
+    vector<BLAStep> steps;
+};
@@ -45,29 +45,17 @@ inline void createBuffer(const LogicalDevice *device, const vk::DeviceSize size,
 
 inline void allocateMemory(const LogicalDevice *device,
                            const vk::MemoryPropertyFlags properties,
-                           const vk::raii::Buffer &buffer, vk::raii::DeviceMemory &memory) {
-    vk::MemoryRequirements memRequirements = buffer.getMemoryRequirements();
-
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.sType = vk::StructureType::eMemoryAllocateInfo;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex =
-        findMemoryType(device, memRequirements.memoryTypeBits, properties);
-
-    memory = device->device.allocateMemory(allocInfo);
-
-    // the fourth parameter is the offset within the region of memory. Since
-    // this memory is allocated specifically for this the vertex buffer, the
-    // offset is simply 0. If the offset is non-zero, then it is required to be
-    // divisible by memRequirements.alignment.
-    buffer.bindMemory(*memory, 0);
+                           const vk::raii::Buffer &buffer, Allocation &memory) {
+    // The memory is a part of a larger block, so the buffer is bound at an
+    // offset that satisfies its alignment. The allocator does both.
+    memory = device->allocator->allocate(*buffer, properties);
 }
 
 void Buffer::createBufferWithMemory(const LogicalDevice *device,
                                     const vk::DeviceSize size,
                                     const vk::BufferUsageFlags usage,
                                     const vk::MemoryPropertyFlags properties,
-                                    vk::raii::Buffer &buffer, vk::raii::DeviceMemory &memory) {
+                                    vk::raii::Buffer &buffer, Allocation &memory) {
     createBuffer(device, size, usage, buffer);
 
     // The buffer has been created, but it doesn't actually have any memory
@@ -76,8 +64,6 @@ void Buffer::createBufferWithMemory(const LogicalDevice *device,
 }
 
 /*
-TODO:
-
 https://developer.nvidia.com/vulkan-memory-management
 
 It should be noted that in a real world application, you're not supposed to
@@ -90,9 +76,8 @@ allocation among many different objects by using the offset parameters that
 we've seen in many functions.
 
 You can either implement such an allocator yourself, or use the
-VulkanMemoryAllocator library provided by the GPUOpen initiative. However, for
-this tutorial it's okay to use a separate allocation for every resource, because
-we won't come close to hitting any of these limits for now.
+VulkanMemoryAllocator library provided by the GPUOpen initiative. We use the
+latter, see MemoryAllocator.
 
 
 */
@@ -108,9 +93,13 @@ void Buffer::copyFromCPU(const void *cpuData) {
     //      and call vkInvalidateMappedMemoryRanges before reading from the
     //      mapped memory (faster!).
 
-    void *data = memory.mapMemory(0, size, {});
-    memcpy(data, cpuData, (size_t)size);
-    memory.unmapMemory();
+    memory.write(cpuData, (size_t)size);
+}
+
+void Buffer::copyFromCPU(const void *cpuData, vk::DeviceSize offset,
+                         vk::DeviceSize range) {
+    assert(offset + range <= size);
+    memory.write(cpuData, (size_t)range, (size_t)offset);
 }
 
 inline void copyBuffer(vk::Device device, vk::CommandPool commandPool,
@@ -137,4 +126,34 @@ void StagedBuffer::copyFromCPU(const void *cpuData, vk::CommandPool commandPool)
 
     copyBuffer(device->handle(), commandPool, *buf.buffer, *buffer, size,
                *device->transferQueue);
-}
\ No newline at end of file
+}
+
+shared_ptr<Buffer> StorageBuffer::record(vk::CommandBuffer commandBuffer,
+                                         const void *cpuData) {
+    auto staging = make_shared<Buffer>(
+        device, size, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent);
+    staging->copyFromCPU(cpuData);
+
+    vk::BufferCopy copyRegion{};
+    copyRegion.size = size;
+    commandBuffer.copyBuffer(*staging->buffer, *buffer, 1, &copyRegion);
+
+    // the shaders of the same command buffer read it afterwards
+    vk::BufferMemoryBarrier barrier{};
+    barrier.sType = vk::StructureType::eBufferMemoryBarrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = *buffer;
+    barrier.offset = 0;
+    barrier.size = size;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eFragmentShader |
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                  {}, {}, barrier, {});
+
+    return staging;
+}
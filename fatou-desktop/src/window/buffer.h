@@ -50,6 +50,16 @@ inline vk::Format getSupportedStencilFormat(const PhysicalDevice *device) {
         vk::FormatFeatureFlagBits::eDepthStencilAttachment);
 }
 
+// Float formats like the iteration counts of the fractal layers don't have to
+// support blending
+inline bool supportsBlending(const PhysicalDevice *device,
+                             vk::Format format) {
+    const vk::FormatProperties props =
+        device->device.getFormatProperties(format);
+    return bool(props.optimalTilingFeatures &
+                vk::FormatFeatureFlagBits::eColorAttachmentBlend);
+}
+
 inline uint32_t findMemoryType(const LogicalDevice *device,
                                const uint32_t typeFilter,
                                const vk::MemoryPropertyFlags properties) {
@@ -114,6 +124,7 @@ class SingleTimeCommandManager : private boost::noncopyable {
         submitInfo.commandBufferCount = commandBuffers.size();
         submitInfo.pCommandBuffers = commandBuffers.data();
 
+        std::lock_guard<std::mutex> lock(LogicalDevice::queueMutex);
         queue.submit(submitInfo, {});
 
         // Unlike the draw commands, there are no events we need to wait on this
@@ -225,6 +236,9 @@ class Buffer : private boost::noncopyable {
     }
 
     void copyFromCPU(const void *data);
+    // only writes the given range, e.g. one slot of a UniformRing
+    void copyFromCPU(const void *data, vk::DeviceSize offset,
+                     vk::DeviceSize range);
 
     vk::Buffer handle() const { return *buffer; }
 
@@ -234,16 +248,17 @@ class Buffer : private boost::noncopyable {
                                        const vk::BufferUsageFlags usage,
                                        const vk::MemoryPropertyFlags properties,
                                        vk::raii::Buffer &buffer,
-                                       vk::raii::DeviceMemory &memory);
+                                       Allocation &memory);
 
   protected:
     shared_ptr<LogicalDevice> device;
     const vk::DeviceSize size;
 
     vk::raii::Buffer buffer;
-    vk::raii::DeviceMemory memory;
+    Allocation memory;
 
     friend class StagedBuffer;
+    friend class StorageBuffer;
 };
 
 // https://vulkan-tutorial.com/en/Vertex_buffers/Index_buffer
@@ -300,4 +315,29 @@ class IndexBuffer : protected StagedBuffer {
         // duplicate vertex data even if just one attribute varies.
         commandBuffer.bindIndexBuffer(*buffer, 0, vk::IndexType::eUint16);
     }
-};
\ No newline at end of file
+};
+
+// Device local buffer for large, read-only shader data (e.g. the reference
+// orbits of the perturbation shaders)
+class StorageBuffer : protected StagedBuffer {
+  public:
+    StorageBuffer(shared_ptr<LogicalDevice> device, const void *data,
+                  vk::DeviceSize size, vk::CommandPool commandPool)
+        : StagedBuffer(device, size, vk::BufferUsageFlagBits::eStorageBuffer) {
+        copyFromCPU(data, commandPool);
+    }
+
+    // Only allocates, the data is copied by record
+    StorageBuffer(shared_ptr<LogicalDevice> device, vk::DeviceSize size)
+        : StagedBuffer(device, size, vk::BufferUsageFlagBits::eStorageBuffer) {
+    }
+
+    // Records copying data into the buffer, ordered before the shaders that
+    // are recorded afterwards. Nothing waits for the queue. The returned
+    // staging buffer must live until the command buffer finished.
+    shared_ptr<Buffer> record(vk::CommandBuffer commandBuffer,
+                              const void *data);
+
+    vk::Buffer handle() const { return *buffer; }
+    vk::DeviceSize range() const { return size; }
+};
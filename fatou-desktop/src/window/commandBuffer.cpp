@@ -36,6 +36,7 @@ void CommandPool::presentFrame(const vk::raii::SwapchainKHR &swapChainHandle,
     // vkAcquireNextImageKHR and vkQueuePresentKHR in the next chapter,
     // because their failure does not necessarily mean that the program
     // should terminate, unlike the functions we've seen so far
+    std::lock_guard<std::mutex> lock(LogicalDevice::queueMutex);
     vk::Result result = device->presentQueue.presentKHR(presentInfo);
     if (result != vk::Result::eSuccess) {
         // TODO
@@ -49,6 +50,15 @@ CommandPool::acquireNextImage(const vk::raii::SwapchainKHR &swapChainHandle,
     // has finished
     inFlightFences[currentFrame]->wait();
 
+    // The fences are waited for in order, so all frames up to the one that
+    // used this slot before are finished
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                 [&](const auto &r) {
+                                     return r.first + MAX_FRAMES_IN_FLIGHT <=
+                                            frameCount;
+                                 }),
+                  retired.end());
+
     // The third parameter specifies a timeout in nanoseconds for an image
     // to become available. The next two parameters specify synchronization
     // objects that are to be signaled when the presentation engine is
@@ -79,6 +89,15 @@ CommandPool::acquireNextImage(const vk::raii::SwapchainKHR &swapChainHandle,
     return imageIndex;
 }
 
+void CommandPool::waitPending() {
+    // the fence of the current slot was reset by acquireNextImage and is only
+    // submitted with this frame
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (i != currentFrame)
+            inFlightFences[i]->wait();
+    }
+}
+
 void CommandPool::submitCommandBuffer() {
     // The first three parameters specify which semaphores to wait on before
     // execution begins and in which stage(s) of the pipeline to wait. We
@@ -122,6 +141,7 @@ void CommandPool::submitCommandBuffer() {
     // inFlightFence. Now on the next frame, the CPU will wait for this
     // command buffer to finish executing before it records new commands
     // into it.
+    std::lock_guard<std::mutex> lock(LogicalDevice::queueMutex);
     device->graphicsQueue.submit({submitInfo},
                                  *inFlightFences[currentFrame]->handle);
 }
@@ -37,8 +37,22 @@ class CommandPool : private boost::noncopyable {
     void swapBuffers() {
         // advance to next frame
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameCount++;
     }
 
+    // Keeps an object alive until the frames that might use it finished,
+    // instead of waiting for the device before dropping it. Also covers the
+    // frame that is recorded right now.
+    void retire(shared_ptr<void> object) {
+        if (object)
+            retired.emplace_back(frameCount, std::move(object));
+    }
+
+    // While recording: waits for the other frames in flight, e.g. before
+    // changing descriptor sets they use. Cheaper than waiting for the device,
+    // which also covers uploads and the transfer queue.
+    void waitPending();
+
     void resetCommandBuffer() { commandBuffers[currentFrame].reset(); }
 
     vk::CommandBuffer currentBuffer() { return *commandBuffers[currentFrame]; }
@@ -72,6 +86,10 @@ class CommandPool : private boost::noncopyable {
     vk::raii::CommandPool commandPoolRenderer = nullptr;
 
     uint32_t currentFrame = 0;
+    // number of frames submitted so far
+    uint64_t frameCount = 0;
+    // see retire, tagged with the frame they were retired in
+    vector<std::pair<uint64_t, shared_ptr<void>>> retired;
 
     vector<shared_ptr<Semaphore>> imageAvailableSemaphores;
     vector<shared_ptr<Semaphore>> renderFinishedSemaphores;
@@ -18,8 +18,7 @@ Compositor::Compositor(shared_ptr<LogicalDevice> device,
 }
 
 void Compositor::draw(vk::CommandBuffer commandBuffer, DescriptorPool *pool) {
-    pool->bind(commandBuffer, commandPool->current(),
-               swapChain->pipeline->layout());
+    pool->bind(commandBuffer, swapChain->pipeline->layout());
 
     vkCmdDrawIndexed(commandBuffer,
                      static_cast<uint32_t>(indices.size()), // number of indices
@@ -30,6 +29,23 @@ void Compositor::draw(vk::CommandBuffer commandBuffer, DescriptorPool *pool) {
     );
 }
 
+void Compositor::drawColorized(vk::CommandBuffer commandBuffer,
+                               DescriptorPool *pool,
+                               const ColorUniformBufferObject &colors) {
+    pool->updateColors(commandPool->current(), colors);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                               swapChain->colorPipeline->getGraphicsPipeline());
+    pool->bind(commandBuffer, swapChain->colorPipeline->layout());
+
+    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1,
+                     0, 0, 0);
+
+    // back to the default pipeline for everything drawn afterwards
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                               swapChain->pipeline->getGraphicsPipeline());
+}
+
 void Compositor::setTransform(DescriptorPool *pool, IRect r) {
     int w = r.right - r.left;
     int h = r.bottom - r.top;
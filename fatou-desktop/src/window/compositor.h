@@ -27,6 +27,14 @@ class Compositor {
             sampler->handle());
     }
 
+    // for images of iteration counts, which are drawn with drawColorized
+    shared_ptr<DescriptorPool> makeColorizeDP(vk::ImageView view) {
+        return make_shared<DescriptorPool>(
+            commandPool->MAX_FRAMES_IN_FLIGHT, device,
+            swapChain->colorPipeline->descriptorSetLayout(), view,
+            sampler->handle(), true);
+    }
+
     void begin(vk::CommandBuffer commandBuffer) {
         vb->bind(commandBuffer);
         ib->bind(commandBuffer);
@@ -59,6 +67,11 @@ class Compositor {
 
     void draw(vk::CommandBuffer commandBuffer, DescriptorPool *pool);
 
+    // Draws iteration counts with the given colours. The pool must be from
+    // makeColorizeDP.
+    void drawColorized(vk::CommandBuffer commandBuffer, DescriptorPool *pool,
+                       const ColorUniformBufferObject &colors);
+
   private:
     shared_ptr<LogicalDevice> device;
 
@@ -23,6 +23,9 @@ class Fence : private boost::noncopyable {
 
     void reset() { device->device.resetFences({*handle}); }
 
+    // without waiting
+    bool signaled() const { return handle.getStatus() == vk::Result::eSuccess; }
+
     ~Fence() { // vkDestroyFence(device->handle(), handle, nullptr);
     }
 
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "highPrecision.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+/*
+Floating point numbers with a separate exponent
+
+A double ends at about 1e-308, which is not very deep for a zoom. FloatExp
+stores m * 2^e with the mantissa normalized to [0.5, 1) (or 0) and an int
+exponent, so it has the precision of a double and (almost) unlimited range.
+It is much cheaper than HighPrecision and good enough for everything that
+doesn't have to be exact, e.g. the zoom and the offsets to the reference
+point.
+
+The shaders use the same idea with a float mantissa (see mandelfe.frag). To
+keep them at float speed, they don't normalize after every operation but
+store a complex number as w * 2^s and only move the magnitude of w into s
+every few iterations.
+*/
+class FloatExp {
+  public:
+    FloatExp(double x = 0.) { m = std::frexp(x, &e); }
+    FloatExp(double mantissa, int exponent) {
+        m = std::frexp(mantissa, &e);
+        if (m != 0.)
+            e += exponent;
+    }
+
+    static FloatExp fromHighPrecision(const HighPrecision &x) {
+        int exponent;
+        const HighPrecision mantissa = frexp(x, &exponent);
+        return FloatExp(mantissa.convert_to<double>(), exponent);
+    }
+
+    // accepts everything HighPrecision accepts, e.g. "1.5e-1000"
+    static FloatExp parse(const string &s) {
+        return fromHighPrecision(HighPrecision(s));
+    }
+
+    HighPrecision toHighPrecision() const {
+        return ldexp(HighPrecision(m), e);
+    }
+
+    // rounds to zero if it is too small for a double
+    double toDouble() const { return std::ldexp(m, e); }
+
+    // log2 of the absolute value, -inf for 0
+    double log2() const { return std::log2(std::abs(m)) + e; }
+
+    string toString() const {
+        if (m == 0.)
+            return "0";
+        const double l = std::log10(std::abs(m)) + e * std::log10(2.);
+        const double d = std::floor(l);
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%.6fe%.0f", m < 0 ? "-" : "",
+                 std::pow(10., l - d), d);
+        return buf;
+    }
+
+    FloatExp operator-() const { return FloatExp(-m, e); }
+
+    friend FloatExp operator*(const FloatExp &a, const FloatExp &b) {
+        return FloatExp(a.m * b.m, a.e + b.e);
+    }
+    friend FloatExp operator/(const FloatExp &a, const FloatExp &b) {
+        return FloatExp(a.m / b.m, a.e - b.e);
+    }
+    friend FloatExp operator+(const FloatExp &a, const FloatExp &b) {
+        // the smaller one just underflows if it doesn't matter
+        if (b.m == 0.)
+            return a;
+        if (a.m == 0.)
+            return b;
+        if (a.e >= b.e)
+            return FloatExp(a.m + std::ldexp(b.m, b.e - a.e), a.e);
+        return FloatExp(b.m + std::ldexp(a.m, a.e - b.e), b.e);
+    }
+    friend FloatExp operator-(const FloatExp &a, const FloatExp &b) {
+        return a + (-b);
+    }
+
+    FloatExp &operator*=(const FloatExp &o) { return *this = *this * o; }
+    FloatExp &operator/=(const FloatExp &o) { return *this = *this / o; }
+
+    // normalized, so the representation is unique
+    friend bool operator==(const FloatExp &a, const FloatExp &b) {
+        return a.m == b.m && (a.m == 0. || a.e == b.e);
+    }
+    friend bool operator!=(const FloatExp &a, const FloatExp &b) {
+        return !(a == b);
+    }
+    friend bool operator<(const FloatExp &a, const FloatExp &b) {
+        return (a - b).m < 0.;
+    }
+    friend bool operator>(const FloatExp &a, const FloatExp &b) {
+        return b < a;
+    }
+    friend bool operator<=(const FloatExp &a, const FloatExp &b) {
+        return !(b < a);
+    }
+    friend bool operator>=(const FloatExp &a, const FloatExp &b) {
+        return !(a < b);
+    }
+
+    double m;
+    int e;
+};
+
+inline FloatExp abs(const FloatExp &x) { return FloatExp(std::abs(x.m), x.e); }
+
+// Splits a complex number into a mantissa and an exponent shared by both
+// parts, i.e. (x, y) = m * 2^e. The smaller part underflows if it doesn't
+// matter.
+inline void toFloatExp(const HighPrecision &x, const HighPrecision &y,
+                       glm::dvec2 &m, int32_t &e) {
+    const FloatExp fx = FloatExp::fromHighPrecision(x);
+    const FloatExp fy = FloatExp::fromHighPrecision(y);
+    e = std::max(fx.m != 0. ? fx.e : INT32_MIN, fy.m != 0. ? fy.e : INT32_MIN);
+    if (e == INT32_MIN)
+        e = 0;
+    m = glm::dvec2(std::ldexp(fx.m, fx.e - e), std::ldexp(fy.m, fy.e - e));
+}
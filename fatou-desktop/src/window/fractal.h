@@ -5,6 +5,8 @@
 #include "compositor.h"
 #include "renderPass.h"
 #include "interlacedRenderer.h"
+#include "perturbation.h"
+#include "precision.h"
 
 #include "sharedTexture.h"
 
@@ -15,26 +17,60 @@ template <class DSL> class Fractal {
   protected:
     Fractal(shared_ptr<LogicalDevice> device, const path &shaderPath,
             Extent2D extent, shared_ptr<CommandPool> commandPool, size_t phases)
-        : device(device), extent(extent) {
-        renderer = make_shared<InterlacedRenderer<DSL>>(
-            device, shaderPath,
-            Extent2D(superSampling * extent.width,
-                     superSampling * extent.height),
-            commandPool, phases);
+        : device(device), extent(extent), commandPool(commandPool),
+          phases(phases) {
+        useShader(shaderPath);
     }
 
   public:
-    void makeDP(Compositor &compositor) { renderer->makeDP(compositor); }
+    void makeDP(Compositor &compositor) {
+        this->compositor = &compositor;
+        for (auto &r : renderers) {
+            r.second->makeDP(compositor);
+        }
+    }
     void present(vk::CommandBuffer commandBuffer, Compositor &compositor,
                  IRect r) {
-        renderer->present(commandBuffer, compositor, r);
+        // after switching the shader, show the old image until there is a
+        // new one
+        ColorUniformBufferObject colors{};
+        colors.iGamma = iGamma;
+        colors.shift = shift;
+        colors.contrast = contrast;
+        colors.phase = phase;
+        colors.smoothing = smoothing;
+
+        if (previous.get() && !renderer->hasImage()) {
+            previous->present(commandBuffer, compositor, r, colors);
+            return;
+        }
+        if (previous.get()) {
+            previous.reset();
+            evictRenderers();
+        }
+        renderer->present(commandBuffer, compositor, r, colors);
     }
     Extent2D getExtent() const { return extent; }
 
+    // False if the last frame already showed everything: the view and the
+    // parameters didn't change and the renderer is done. The colours only
+    // change with presets.
+    bool needsFrame() {
+        return !presetLoader.empty() || parametersChanged || navi.x != xo ||
+               navi.y != yo || navi.z != az || switchReady() ||
+               (waiting ? progressed() : renderer->needsFrame());
+    }
+
     void renderStep(const CommandBufferRecorder &rec,
                     vk::CommandBuffer commandBuffer, size_t bufferIndex) {
 
         if (!presetLoader.empty()) {
+            // only these need to iterate again, the colours are applied
+            // when presenting
+            const HighPrecision oldX = navi.x, oldY = navi.y;
+            const FloatExp oldZ = navi.z;
+            const int oldMaxiter = maxiter;
+            const float oldPlay = play, oldRadius = radius;
 
             iGamma = .7;
             play = 0.;
@@ -56,14 +92,15 @@ template <class DSL> class Fractal {
                               << it->second.get_value<std::string>()
                               << std::endl;
 
+                    // parse the string to keep all digits of deep zooms
                     if (it->first == "x") {
-                        navi.x = it->second.get_value<double>();
+                        navi.x = HighPrecision(it->second.data());
                     }
                     if (it->first == "y") {
-                        navi.y = it->second.get_value<double>();
+                        navi.y = HighPrecision(it->second.data());
                     }
                     if (it->first == "zoom") {
-                        navi.z = it->second.get_value<double>();
+                        navi.z = FloatExp::parse(it->second.data());
                     }
                     if (it->first == "iterations") {
                         maxiter = it->second.get_value<int>();
@@ -89,6 +126,13 @@ template <class DSL> class Fractal {
                     if (it->first == "smoothing") {
                         smoothing = it->second.get_value<double>();
                     }
+                    // not reset by other presets, so both backends can be
+                    // compared on the same views
+                    if (it->first == "backend") {
+                        useBackend(it->second.data() == "compute"
+                                       ? RenderBackend::eCompute
+                                       : RenderBackend::eGraphics);
+                    }
 
                     //   print(it->second);
                 }
@@ -97,51 +141,240 @@ template <class DSL> class Fractal {
                 std::cerr << e.what() << std::endl;
             }
 
-            renderer->hardInvalidate();
+            if (navi.x != oldX || navi.y != oldY || navi.z != oldZ ||
+                maxiter != oldMaxiter || play != oldPlay ||
+                radius != oldRadius) {
+                renderer->hardInvalidate();
+            }
         }
 
         UniformBufferObject2 ubo2{};
-        double ax, ay;
+        HighPrecision ax, ay;
         navi.getAdjustedPos(ax, ay);
-        ubo2.pos.x = ax;
-        ubo2.pos.y = ay;
-        ubo2.zoom = navi.z;
-
-        parametersChanged |= ax != axo;
-        parametersChanged |= ay != ayo;
-        parametersChanged |= navi.z != az;
-        axo = ax;
-        ayo = ay;
+        // the emulated shaders need more than the 53 bits of pos
+        split(ax, ubo2.pos.x, ubo2.posLo.x);
+        split(ay, ubo2.pos.y, ubo2.posLo.y);
+        split(ax, ubo2.posFF.x, ubo2.posFF.y);
+        split(ay, ubo2.posFF.z, ubo2.posFF.w);
+        ubo2.zoom = navi.z.toDouble();
+        ubo2.zoomMantissa = float(navi.z.m);
+        ubo2.zoomExponent = navi.z.e;
+
+        // Moving or zooming keeps the image, see pan() and zoom(). Scale and
+        // offset of the corner are relative to the last view.
+        const bool moved = navi.x != xo || navi.y != yo;
+        const bool zoomed = navi.z != az;
+        double scale = 1., offsetX = 0., offsetY = 0.;
+        if ((moved || zoomed) && !parametersChanged) {
+            scale = (navi.z / az).toDouble();
+            offsetX = (FloatExp::fromHighPrecision(ax - cornerX) / az)
+                          .toDouble();
+            offsetY = (FloatExp::fromHighPrecision(ay - cornerY) / az)
+                          .toDouble();
+        }
+        xo = navi.x;
+        yo = navi.y;
         az = navi.z;
+        cornerX = ax;
+        cornerY = ay;
 
         ubo2.iter = maxiter;
-        ubo2.iGamma = iGamma;
         ubo2.play = play;
-        ubo2.shift = shift;
-        ubo2.contrast = contrast;
-        ubo2.phase = phase;
         ubo2.radius = radius;
-        ubo2.smoothing = smoothing;
+
+        if (switchReady())
+            useShader(shader);
+        waiting = !prepare(commandBuffer, ubo2);
 
         if (parametersChanged) {
             renderer->invalidate();
             parametersChanged = false;
+        } else if (zoomed) {
+            renderer->zoom(commandBuffer, scale, offsetX, offsetY);
+        } else if (moved) {
+            renderer->pan(commandBuffer, offsetX, offsetY);
         }
 
-        renderer->renderStep(rec, commandBuffer, ubo2, bufferIndex);
+        // e.g. while the reference orbit is computed
+        if (!waiting)
+            renderer->renderStep(rec, commandBuffer, ubo2, bufferIndex);
     }
 
     const Extent2D extent;
 
+  protected:
+    // Hook for fractals which need more than the uniforms, e.g. buffers.
+    // Copies can be recorded into commandBuffer. Returns false if they are
+    // not ready yet, nothing is rendered then.
+    virtual bool prepare(vk::CommandBuffer commandBuffer,
+                         UniformBufferObject2 &ubo2) {
+        return true;
+    }
+    // true if prepare might succeed now after it returned false
+    virtual bool progressed() const { return true; }
+    // called when a renderer is dropped, see evictRenderers
+    virtual void dropped(const InterlacedRenderer<DSL> *r) {}
+
+    // Renders with the given fragment shader from now on. Its pipelines are
+    // built on another thread, the current renderer is used until they are
+    // ready. Returns true if the renderer changed, i.e. its buffers have to
+    // be bound.
+    bool useShader(const path &shader) {
+        this->shader = shader;
+        const auto r = getRenderer(shader);
+        if (!r.get() || r == renderer)
+            return false;
+
+        if (renderer.get() && renderer->hasImage())
+            previous = renderer;
+        renderer = r;
+        parametersChanged = true;
+        evictRenderers();
+        return true;
+    }
+
+    // Builds the pipelines of a shader before it is needed, so switching to
+    // it later is quick. An empty path expects no switch.
+    void prewarmShader(const path &shader) {
+        const string key = shader.empty() ? string() : keyFor(shader);
+        if (key == upcoming)
+            return;
+        upcoming = key;
+        if (!shader.empty() && !renderers.count(key) && !builds.count(key)) {
+            builds[key] = InterlacedRenderer<DSL>::buildVariant(
+                device, backend, shader, layerExtent());
+        }
+        evictRenderers();
+    }
+
+    // true if the pipelines of the shader are built, i.e. useShader switches
+    bool switchReady() const {
+        const auto i = builds.find(keyFor(shader));
+        if (i == builds.end() || i->second.wait_for(std::chrono::seconds(0)) !=
+                                     std::future_status::ready)
+            return false;
+        const auto &pipelines = i->second.get();
+        return pipelines.graphics || pipelines.compute;
+    }
+
+    // Renders the current and all following shaders with the given backend.
+    // Falls back to the graphics backend if the device can't do it.
+    void useBackend(RenderBackend b) {
+        if (b == RenderBackend::eCompute &&
+            !supportsComputeBackend(&*device->physical)) {
+            std::cerr << "compute backend not supported" << std::endl;
+            b = RenderBackend::eGraphics;
+        }
+        backend = b;
+        useShader(shader);
+        commitJS("setRenderParams",
+                 "{backend:" +
+                     jsStr(string(b == RenderBackend::eCompute ? "compute"
+                                                               : "graphics")) +
+                     "}");
+    }
+
+  private:
+    string keyFor(const path &shader) const {
+        string key = shader.string();
+        if (backend == RenderBackend::eCompute)
+            key += ":compute";
+        return key;
+    }
+
+    Extent2D layerExtent() const {
+        return Extent2D(superSampling * extent.width,
+                        superSampling * extent.height);
+    }
+
+    // The renderer of a shader, null while its pipelines are built
+    shared_ptr<InterlacedRenderer<DSL>> getRenderer(const path &shader) {
+        const string key = keyFor(shader);
+        const auto i = renderers.find(key);
+        if (i != renderers.end())
+            return i->second;
+
+        auto &build = builds[key];
+        if (!build.valid()) {
+            build = InterlacedRenderer<DSL>::buildVariant(
+                device, backend, shader, layerExtent());
+        }
+        // without a renderer, there is nothing else to show
+        if (renderer.get() && build.wait_for(std::chrono::seconds(0)) !=
+                                  std::future_status::ready)
+            return nullptr;
+
+        const auto pipelines = build.get();
+        if (!pipelines.graphics && !pipelines.compute) {
+            if (!renderer.get())
+                throw std::runtime_error("couldn't build " + shader.string());
+            // the build stays, so it isn't tried again and again
+            return nullptr;
+        }
+        builds.erase(key);
+
+        auto r = make_shared<InterlacedRenderer<DSL>>(
+            device, shader, layerExtent(), commandPool, phases, pipelines);
+        if (compositor)
+            r->makeDP(*compositor);
+        renderers[key] = r;
+        return r;
+    }
+
+    // Each renderer holds full-size layers, so only the current, the
+    // previous and the upcoming one are kept. Pending frames may still use
+    // the others, they are released once these are finished.
+    void evictRenderers() {
+        for (auto i = renderers.begin(); i != renderers.end();) {
+            const auto r = i->second;
+            if (r == renderer || r == previous || i->first == upcoming) {
+                i++;
+                continue;
+            }
+            dropped(r.get());
+            commandPool->retire(r);
+            i = renderers.erase(i);
+        }
+
+        // destroying unfinished ones would wait for them
+        for (auto i = builds.begin(); i != builds.end();) {
+            if (i->first != keyFor(shader) && i->first != upcoming &&
+                i->second.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready)
+                i = builds.erase(i);
+            else
+                i++;
+        }
+    }
+
   protected:
     shared_ptr<LogicalDevice> device;
     shared_ptr<CommandPool> commandPool;
     shared_ptr<InterlacedRenderer<DSL>> renderer;
+    // presented until the renderer has an image
+    shared_ptr<InterlacedRenderer<DSL>> previous;
+    std::map<string, shared_ptr<InterlacedRenderer<DSL>>> renderers;
+    // pipelines of shaders without a renderer, see getRenderer
+    std::map<string,
+             std::shared_future<typename InterlacedRenderer<DSL>::Variant>>
+        builds;
+    // key of the shader prewarmShader expects, if any
+    string upcoming;
+    // shader of the current renderer
+    path shader;
+    RenderBackend backend = RenderBackend::eGraphics;
+    const size_t phases;
+    Compositor *compositor = nullptr;
 
     const int superSampling = 2;
 
     bool parametersChanged = true;
-    double axo, ayo, az;
+    // the last prepare returned false
+    bool waiting = false;
+    HighPrecision xo, yo;
+    FloatExp az;
+    // lower left corner of the last view
+    HighPrecision cornerX, cornerY;
 
     int maxiter = 100;
 
@@ -154,12 +387,87 @@ template <class DSL> class Fractal {
     float smoothing = 1.0;
 };
 
-class Fractal_Mandel : public Fractal<MandelDescriptorSetLayout> {
+class Fractal_Mandel : public Fractal<PerturbationDescriptorSetLayout> {
   public:
     Fractal_Mandel(shared_ptr<LogicalDevice> device, Extent2D e,
                    shared_ptr<CommandPool> commandPool, size_t phases)
-        : Fractal(device, shaderPath / "playground" / "mandeld.frag", e,
-                  commandPool, phases) {}
+        : Fractal(device, shaderFor(Precision::eFloat), e, commandPool,
+                  phases),
+          perturbation(make_shared<Perturbation>(device, commandPool)),
+          selector(device->physical->features.shaderFloat64) {}
+
+  protected:
+    bool prepare(vk::CommandBuffer commandBuffer,
+                 UniformBufferObject2 &ubo2) override {
+        const Extent2D e(superSampling * extent.width,
+                         superSampling * extent.height);
+        const Precision precision = selector.select(navi.z, e, maxiter);
+        useShader(shaderFor(precision));
+        if (precision != committedPrecision) {
+            commitJS("setRenderParams",
+                     "{precision:" +
+                         jsStr(string(PrecisionSelector::name(precision))) +
+                         "}");
+            committedPrecision = precision;
+        }
+        prewarmShader(selector.upcoming() != precision
+                          ? shaderFor(selector.upcoming())
+                          : path());
+
+        if (precision != Precision::ePerturbation &&
+            precision != Precision::ePerturbationFloatExp) {
+            return true;
+        }
+
+        HighPrecision cx, cy;
+        navi.getCenter(cx, cy);
+
+        perturbation->update(commandBuffer, cx, cy, navi.z, maxiter, radius);
+        if (!perturbation->usable(navi.z))
+            return false;
+
+        // Bind the buffers if they were replaced or the renderer has older
+        // ones. Renderers that were never bound can't be in use yet.
+        uint64_t &bound = boundGeneration[renderer.get()];
+        if (bound != perturbation->generation()) {
+            if (bound != 0) {
+                // the descriptor sets might still be used by the other frame
+                // in flight
+                commandPool->waitPending();
+            }
+            renderer->updateStorage(2, perturbation->handle(),
+                                    perturbation->range());
+            renderer->updateStorage(3, perturbation->blaHandle(),
+                                    perturbation->blaRange());
+            bound = perturbation->generation();
+            parametersChanged = true;
+        }
+
+        ubo2.refOffset = perturbation->offset(cx, cy);
+        ubo2.refOffsetScaled =
+            glm::vec2(perturbation->offset(cx, cy, navi.z.e));
+        return true;
+    }
+
+    bool progressed() const override { return perturbation->finished(); }
+
+    void dropped(const InterlacedRenderer<PerturbationDescriptorSetLayout> *r)
+        override {
+        // a new renderer might get the same address
+        boundGeneration.erase(r);
+    }
+
+  private:
+    static path shaderFor(Precision p) {
+        return shaderVariant(shaderPath / "playground" /
+                                 PrecisionSelector::shader(p),
+                             PrecisionSelector::variant(p));
+    }
 
   private:
+    shared_ptr<Perturbation> perturbation;
+    PrecisionSelector selector;
+    optional<Precision> committedPrecision;
+    // Perturbation::generation() of the buffers bound to each renderer
+    std::map<const void *, uint64_t> boundGeneration;
 };
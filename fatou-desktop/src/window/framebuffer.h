@@ -10,15 +10,16 @@ class FractalFramebuffer : private boost::noncopyable {
   public:
     FractalFramebuffer(shared_ptr<LogicalDevice> device,
                        vk::CommandPool commandPool,
-                       shared_ptr<PipelineBase> pipeline,
+                       shared_ptr<PipelineBase> pipeline, Extent2D extent,
                        vk::ImageUsageFlags moreFlags = {},
                        vk::Format stencilFormat = vk::Format::eUndefined)
-        : device(device), extent(pipeline->extent), pipeline(pipeline),
+        : device(device), extent(extent), pipeline(pipeline),
           framebuffer(nullptr) {
 
         tex = make_shared<OnlineTexture>(
             device, commandPool, extent.width, extent.height,
-            vk::ImageUsageFlagBits::eColorAttachment | moreFlags);
+            vk::ImageUsageFlagBits::eColorAttachment | moreFlags,
+            pipeline->imageFormat);
         tex->transitionToRead();
         vector<vk::ImageView> attachments = {tex->imageView()};
 
@@ -40,7 +41,8 @@ class FractalFramebuffer : private boost::noncopyable {
 
         // You can only use a framebuffer with the render passes that it is
         // compatible with, which roughly means that they use the same number
-        // and type of attachments.
+        // and type of attachments. The extent doesn't matter, so the layers
+        // of different size share the render passes.
         framebufferInfo.renderPass = pipeline->getRenderPass();
 
         framebufferInfo.attachmentCount = attachments.size();
@@ -70,6 +72,9 @@ class FractalFramebuffer : private boost::noncopyable {
     vk::Framebuffer getFramebuffer() { return *framebuffer; }
 
     void transition(vk::ImageLayout l) { tex->transitionTo(l); }
+    void transition(vk::CommandBuffer commandBuffer, vk::ImageLayout l) {
+        tex->transitionTo(commandBuffer, l);
+    }
 
     void beforeRead() {
         // Too late to transition; it must be transitioned by now
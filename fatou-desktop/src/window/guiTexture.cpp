@@ -0,0 +1,91 @@
+#include "guiTexture.h"
+#include "compositor.h"
+
+GuiTexture::GuiTexture(shared_ptr<LogicalDevice> device,
+                       Compositor &compositor, int w, int h)
+    : w(w), h(h), device(device) {
+    // Only the paint thread records into this pool. The uploads go to the
+    // graphics queue, see the class comment.
+    vk::CommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = vk::StructureType::eCommandPoolCreateInfo;
+    poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+    poolInfo.queueFamilyIndex = device->indices.graphicsFamily.value();
+    commandPool = device->device.createCommandPool(poolInfo);
+
+    vk::CommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = vk::StructureType::eCommandBufferAllocateInfo;
+    allocInfo.commandPool = *commandPool;
+    allocInfo.level = vk::CommandBufferLevel::ePrimary;
+    allocInfo.commandBufferCount = uint32_t(slots.size());
+    vector<vk::raii::CommandBuffer> commandBuffers =
+        device->device.allocateCommandBuffers(allocInfo);
+
+    // transparent until CEF paints
+    const vector<uint8_t> clear(size_t(w) * h * 4, 0);
+    for (size_t i = 0; i < slots.size(); i++) {
+        Slot &slot = slots[i];
+        slot.texture = make_shared<OnlineTexture>(device, *commandPool, w, h);
+        slot.pool = compositor.makeDP(slot.texture->imageView());
+        slot.commandBuffer = std::move(commandBuffers[i]);
+        slot.uploaded = make_shared<Fence>(device, true);
+        slot.pending = {vk::Rect2D({0, 0}, {uint32_t(w), uint32_t(h)})};
+        submit(slot, clear.data());
+    }
+}
+
+GuiTexture::~GuiTexture() {
+    // the command buffers and staging buffers may still be in use
+    for (Slot &slot : slots)
+        slot.uploaded->wait();
+}
+
+bool GuiTexture::paint(const uint8_t *data, const vector<vk::Rect2D> &rects) {
+    // every texture but the back one gets these rects with a later paint
+    for (Slot &slot : slots) {
+        if (slot.pending.size() + rects.size() > maxPending) {
+            slot.pending = {vk::Rect2D({0, 0}, {uint32_t(w), uint32_t(h)})};
+        } else {
+            slot.pending.insert(slot.pending.end(), rects.begin(),
+                                rects.end());
+        }
+    }
+
+    // the staging buffer may still be read
+    if (!slots[back].uploaded->signaled())
+        return false;
+    submit(slots[back], data);
+
+    // The render loop sees the texture only after the upload was submitted,
+    // so its frame is ordered after the upload on the queue
+    back = middle.exchange(back | fresh) & ~fresh;
+    return true;
+}
+
+DescriptorPool *GuiTexture::latest() {
+    if (middle.load() & fresh)
+        front = middle.exchange(front) & ~fresh;
+    return slots[front].pool.get();
+}
+
+void GuiTexture::submit(Slot &slot, const uint8_t *data) {
+    // the staging buffer is written while recording
+    assert(slot.uploaded->signaled());
+    slot.uploaded->reset();
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = vk::StructureType::eCommandBufferBeginInfo;
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    slot.commandBuffer.reset();
+    slot.commandBuffer.begin(beginInfo);
+    slot.texture->record(*slot.commandBuffer, data, slot.pending);
+    slot.commandBuffer.end();
+    slot.pending.clear();
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.sType = vk::StructureType::eSubmitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &*slot.commandBuffer;
+
+    std::lock_guard<std::mutex> lock(LogicalDevice::queueMutex);
+    device->graphicsQueue.submit(submitInfo, *slot.uploaded->handle);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "texture.h"
+#include "fence.h"
+#include "ubo.h"
+
+class Compositor;
+
+// The GUI painted by CEF, triple buffered: CEF's paint thread uploads into
+// the back texture and publishes it as the middle one, the render loop takes
+// the middle one as its front texture if it is newer. The indices are swapped
+// atomically, so neither thread ever waits for the other's frame.
+//
+// The uploads are submitted to the graphics queue. There they are ordered
+// with the frames, and the barriers of the upload wait for frames that still
+// sample a texture the render loop just gave back. Behind the fractal work of
+// those frames, an upload may take a while. The paint thread doesn't wait for
+// it, it skips paints while the back texture is still being uploaded.
+class GuiTexture : private boost::noncopyable {
+  public:
+    GuiTexture(shared_ptr<LogicalDevice> device, Compositor &compositor, int w,
+               int h);
+    ~GuiTexture();
+
+    // Paint thread: data has all w * h pixels, rects tells which changed.
+    // Never waits. Returns false if the upload into the back texture two
+    // paints ago isn't finished yet. The rects are then uploaded with the
+    // next paint, which has to be requested if no other one follows.
+    bool paint(const uint8_t *data, const vector<vk::Rect2D> &rects);
+
+    // Render loop: the pool of the newest painted texture
+    DescriptorPool *latest();
+    // Render loop: true if latest() would return a newer texture
+    bool painted() const { return middle.load() & fresh; }
+
+    const int w;
+    const int h;
+
+  private:
+    struct Slot {
+        shared_ptr<OnlineTexture> texture;
+        shared_ptr<DescriptorPool> pool;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+        // signaled when the last upload into texture finished
+        shared_ptr<Fence> uploaded;
+        // Painted since the last upload into texture, i.e. what it misses.
+        // Only touched by the paint thread.
+        vector<vk::Rect2D> pending;
+    };
+
+    // Uploads the pending rects of data into the texture of slot. Its last
+    // upload has to be finished.
+    void submit(Slot &slot, const uint8_t *data);
+
+    // more rects are merged into a full upload
+    static constexpr size_t maxPending = 16;
+    // set in middle if the paint thread published it after the last latest()
+    static constexpr int fresh = 4;
+
+    const shared_ptr<LogicalDevice> device;
+    vk::raii::CommandPool commandPool = nullptr;
+    std::array<Slot, 3> slots;
+
+    // only used by the paint thread
+    int back = 0;
+    std::atomic<int> middle{1};
+    // only used by the render loop
+    int front = 2;
+};
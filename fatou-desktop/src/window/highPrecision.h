@@ -0,0 +1,27 @@
+#pragma once
+
+#include <boost/multiprecision/cpp_bin_float.hpp>
+
+// Arbitrary precision floats for everything that has to stay exact beyond the
+// 53 bits of a double, i.e. the position of the viewport and the reference
+// orbits of the perturbation renderer. Expression templates are disabled
+// because they don't mix well with auto and are hardly faster for our tiny
+// expressions.
+template <unsigned Bits>
+using FixedPrecision = boost::multiprecision::number<
+    boost::multiprecision::cpp_bin_float<
+        Bits, boost::multiprecision::digit_base_2>,
+    boost::multiprecision::et_off>;
+
+// Precision of the navigator. This limits how deep you can zoom at all.
+using HighPrecision = FixedPrecision<2048>;
+
+inline double toDouble(const HighPrecision &x) {
+    return x.convert_to<double>();
+}
+
+// Splits x into an unevaluated sum hi + lo, e.g. for the double-double shaders
+template <class T> void split(const HighPrecision &x, T &hi, T &lo) {
+    hi = x.convert_to<T>();
+    lo = HighPrecision(x - hi).convert_to<T>();
+}
@@ -9,26 +9,86 @@
 #include "pingable.h"
 #include "timing.h"
 #include "commandBuffer.h"
+#include "sharedTexture.h"
 #include "../gui/cef/js.h"
 
+#include <future>
+
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 template <class DSL> class InterlacedRenderer {
   public:
+    // The pipelines of one FractalSpecialization or of the generic shader,
+    // one of them is null. Both are null if the shader didn't compile.
+    struct Variant {
+        shared_ptr<MultiPipeline<DSL>> graphics;
+        shared_ptr<ComputePipeline> compute;
+    };
+
+    // Builds the pipelines on another thread. For a specialization, the
+    // SPIR-V is already compiled and only the driver has to compile it again
+    // with the constants. Otherwise, shaderc compiles the shader there as
+    // well.
+    static std::shared_future<Variant>
+    buildVariant(shared_ptr<LogicalDevice> device, RenderBackend backend,
+                 const path &path, Extent2D extent,
+                 Specialization constants = {}) {
+        return std::async(
+            std::launch::async,
+            [device, backend, path, extent, constants]() -> Variant {
+                Variant v;
+                try {
+                    if (backend == RenderBackend::eCompute) {
+                        v.compute = make_shared<ComputePipeline>(
+                            device, path,
+                            shaderPath / "playground" / "interlace.comp",
+                            constants);
+                    } else {
+                        v.graphics = make_shared<MultiPipeline<DSL>>(
+                            device, path, extent,
+                            vk::ImageLayout::eShaderReadOnlyOptimal,
+                            constants);
+                    }
+                } catch (const std::exception &e) {
+                    // the pipelines in use keep working
+                    std::cout << "couldn't build pipeline: " << e.what()
+                              << std::endl;
+                }
+                // the main loop might wait for it, see Fractal::needsFrame
+                wakeMainLoop();
+                return v;
+            });
+    }
+
+    // The generic pipelines are built with buildVariant beforehand, the
+    // stencils are written with the first frame. So nothing here waits for
+    // the queue.
     InterlacedRenderer(shared_ptr<LogicalDevice> device, const path &path,
                        Extent2D extent, shared_ptr<CommandPool> commandPool,
-                       size_t phases)
+                       size_t phases, const Variant &pipelines)
         : device(device), extent(extent), commandPool(commandPool),
-          timer(device, phases) {
+          timer(device, phases),
+          backend(pipelines.compute ? RenderBackend::eCompute
+                                    : RenderBackend::eGraphics),
+          graphics(pipelines.graphics), compute(pipelines.compute),
+          fractalShader(path) {
+        assert(graphics || compute);
+
+        if (backend == RenderBackend::eCompute) {
+            // the new pixels of each layer are known without a stencil
+            createFramebuffers(path);
+            invalidate();
+            return;
+        }
 
         vb = make_shared<VertexBuffer<Vertex2>>(device, vertices2,
                                                 commandPool->renderer());
         ib = make_shared<IndexBuffer>(device, indices, commandPool->renderer());
 
         createFramebuffers(path);
-        initStencil();
+        stencilPending = true;
         invalidate();
     }
 
@@ -66,20 +126,8 @@ template <class DSL> class InterlacedRenderer {
         int y = 0;
 
         while (width * height > minArea) {
-            // TODO: Share the pipeline between buffers! this might be faster!
-            /*
-            Sascha Willems:
-            If your framebuffers comply to the compatibility rules then you can
-            reuse a pipeline and renderpass with different framebuffers, and
-            that should work fine.
-
-            Another option is to use a layered framebuffer with each layer
-            representing a different shadow map, and either use geometry shaders
-            (when available) or multiview to render to the different layers.
-            This will only require a single renderpass and may be faster.
-
-            I do have samples for both in my repository.
-            */
+            // All layers share the pipelines (see MultiPipeline), only the
+            // framebuffers and descriptor sets are per layer:
             /*
             8.2. Render Pass Compatibility
 
@@ -115,11 +163,7 @@ template <class DSL> class InterlacedRenderer {
 
             */
 
-            pipeline.push_back(make_shared<MultiPipe<DSL>>(
-                device, path, Extent2D(width, height), commandPool->transfer(),
-                vk::ImageUsageFlagBits::eTransferSrc |
-                    vk::ImageUsageFlagBits::eTransferDst,
-                vk::ImageLayout::eShaderReadOnlyOptimal, true));
+            pushLayer(path, Extent2D(width, height));
 
             pushXYWH(x, y, cutoffX, cutoffY);
             if (width % 2 == 1) {
@@ -129,11 +173,7 @@ template <class DSL> class InterlacedRenderer {
             width /= 2;
             pixSizeX *= 2;
 
-            pipeline.push_back(make_shared<MultiPipe<DSL>>(
-                device, path, Extent2D(width, height), commandPool->transfer(),
-                vk::ImageUsageFlagBits::eTransferSrc |
-                    vk::ImageUsageFlagBits::eTransferDst,
-                vk::ImageLayout::eShaderReadOnlyOptimal, true));
+            pushLayer(path, Extent2D(width, height));
 
             pushXYWH(x, y, cutoffX, cutoffY);
             if (height % 2 == 1) {
@@ -147,6 +187,20 @@ template <class DSL> class InterlacedRenderer {
         }
     }
 
+    void pushLayer(const path &path, Extent2D e) {
+        const auto flags = vk::ImageUsageFlagBits::eTransferSrc |
+                           vk::ImageUsageFlagBits::eTransferDst;
+        if (backend == RenderBackend::eCompute) {
+            pipeline.push_back(make_shared<MultiPipe<DSL>>(
+                device, compute, e, commandPool->transfer(),
+                commandPool->MAX_FRAMES_IN_FLIGHT, flags));
+        } else {
+            pipeline.push_back(make_shared<MultiPipe<DSL>>(
+                device, graphics, e, commandPool->transfer(),
+                commandPool->MAX_FRAMES_IN_FLIGHT, flags));
+        }
+    }
+
     // stores transforms for a framebuffer (for usage in updatePerspective)
     void pushXYWH(int x, int y, int cutoffX, int cutoffY) {
         const double ow = std::max(1.0f, extent.height / float(extent.width));
@@ -164,38 +218,27 @@ template <class DSL> class InterlacedRenderer {
         hs.push_back(oh * dy);
     }
 
-    // writs horizontal or vertical 1px-bars to the stencil buffers
-    void initStencil() {
-
-        vk::CommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = vk::StructureType::eCommandBufferAllocateInfo;
-        allocInfo.level = vk::CommandBufferLevel::ePrimary;
-        allocInfo.commandPool = commandPool->renderer();
-        allocInfo.commandBufferCount = 1;
-
-        vector<vk::raii::CommandBuffer> commandBuffers =
-            device->device.allocateCommandBuffers(allocInfo);
-
+    // Writes horizontal or vertical 1px-bars to the stencil buffers. Recorded
+    // into the first frame of the renderer, before anything reads them.
+    void initStencil(const CommandBufferRecorder &rec,
+                     vk::CommandBuffer commandBuffer) {
         UniformBufferObject ubo{};
         ubo.view = glm::mat4(1.0f);
         ubo.proj = glm::mat4(1.0f);
         ubo.proj[0][0] *= -1;
 
         {
-            CommandBufferRecorder rec(*commandBuffers[0]);
-
             bool isHori = false;
             for (size_t i = 0; i < pipeline.size(); i++) {
                 isHori = !isHori;
 
                 const auto rpm = makeRPM(rec, i, MultiPipeMode::eStencilWrite);
                 {
-                    vb->bind(*commandBuffers[0]);
-                    ib->bind(*commandBuffers[0]);
-
-                    pipeline[i]->bind(*commandBuffers[0],
-                                      MultiPipeMode::eStencilWrite);
+                    vb->bind(commandBuffer);
+                    ib->bind(commandBuffer);
 
+                    // bound after updateVertex, which picks the slot of the
+                    // uniform ring the dynamic offset points at
                     size_t mj = 0;
                     if (isHori) {
                         mj = pipeline[i]->extent.width;
@@ -216,11 +259,14 @@ template <class DSL> class InterlacedRenderer {
                         ubo.view[0][0] = 0;
                         ubo.view[0][1] = 0;
 
-                        pipeline[i]->updateVertex(ubo,
-                                                  MultiPipeMode::eStencilWrite);
+                        pipeline[i]->updateVertex(
+                            commandPool->current(), ubo,
+                            MultiPipeMode::eStencilWrite);
+                        pipeline[i]->bind(commandBuffer,
+                                          MultiPipeMode::eStencilWrite);
 
                         vkCmdDrawIndexed(
-                            *commandBuffers[0],
+                            commandBuffer,
                             static_cast<uint32_t>(
                                 indices.size()), // number of indices
                             1,                   // number of instances
@@ -262,13 +308,16 @@ template <class DSL> class InterlacedRenderer {
                             ubo.view[0][1] = d * 4.;
                         }
 
-                        pipeline[i]->updateVertex(ubo,
-                                                  MultiPipeMode::eStencilWrite);
+                        pipeline[i]->updateVertex(
+                            commandPool->current(), ubo,
+                            MultiPipeMode::eStencilWrite);
+                        pipeline[i]->bind(commandBuffer,
+                                          MultiPipeMode::eStencilWrite);
 
                         ///////////////////////////
 
                         vkCmdDrawIndexed(
-                            *commandBuffers[0],
+                            commandBuffer,
                             static_cast<uint32_t>(
                                 indices.size()), // number of indices
                             (mj + 1) / 2,        // #instances, +1 if odd size
@@ -281,22 +330,167 @@ template <class DSL> class InterlacedRenderer {
             }
         }
 
-        vk::SubmitInfo submitInfo{};
-        submitInfo.sType = vk::StructureType::eSubmitInfo;
-        submitInfo.commandBufferCount = commandBuffers.size();
-        submitInfo.pCommandBuffers = &*commandBuffers[0];
-        device->graphicsQueue.submit(submitInfo, {});
-
-        device->graphicsQueue.waitIdle();
+        // The render passes of the same frame that read the stencils wait
+        // for the writes, like the blits wait for the colours (see
+        // renderRect)
+        for (auto &p : pipeline)
+            p->transition(commandBuffer,
+                          vk::ImageLayout::eShaderReadOnlyOptimal);
+        vk::MemoryBarrier barrier{};
+        barrier.sType = vk::StructureType::eMemoryBarrier;
+        barrier.srcAccessMask =
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        barrier.dstAccessMask =
+            vk::AccessFlagBits::eDepthStencilAttachmentRead |
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eLateFragmentTests,
+            vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                vk::PipelineStageFlagBits::eLateFragmentTests,
+            {}, barrier, {}, {});
     }
 
     void invalidate() {
-        // TODO: restore from buffer translation, i.e. don't discard everything
-        // if not necessary!
+        restart();
+        previewActive = false;
+    }
 
-        // back in max layer
-        finishedLayer = maxLayer;
+    // Moves and scales the viewport without starting from scratch. The new
+    // texture coordinate t corresponds to t * scale + (dx, dy) before. The
+    // finest finished image (or the last preview, if it is finer) is
+    // resampled into a preview, which is drawn over the layers until they
+    // catch up. If the samples of a layer coincide with old ones, that layer
+    // is copied and counts as finished. The copies are recorded into the
+    // command buffer of the frame.
+    void zoom(vk::CommandBuffer commandBuffer, double scale, double dx,
+              double dy) {
+        const bool fromPreview =
+            previewActive &&
+            (!hasImage() || previewSize < pixelSize(finishedLayer));
+        if ((!hasImage() && !fromPreview) || !compositor) {
+            invalidate();
+            return;
+        }
+
+        if (!preview.get()) {
+            // the size of the first (largest) layer
+            preview = make_shared<OnlineTexture>(
+                device, commandPool->transfer(), pipeline[0]->extent.width,
+                pipeline[0]->extent.height,
+                vk::ImageUsageFlagBits::eTransferSrc,
+                MultiPipe<DSL>::imageFormat);
+            previewDescriptorPool =
+                compositor->makeColorizeDP(preview->imageView());
+        }
+
+        const size_t b = finishedLayer;
+
+        // source pixel = alpha * pixel + beta for the pixels of the preview,
+        // which has the geometry of layer 0
+        const size_t source = fromPreview ? 0 : b;
+        glm::dvec2 alpha, beta;
+        mapPixels(0, source, scale, dx, dy, alpha, beta);
+        const double sourceSize = fromPreview ? previewSize : 1.;
+
+        resamplePreview(commandBuffer, fromPreview, b, alpha, beta);
+        previewSize =
+            std::max(1., sourceSize / std::min(alpha.x, alpha.y));
+        previewActive = true;
+
+        restart();
+
+        if (!fromPreview) {
+            reuseExactLayer(commandBuffer, b, scale, dx, dy);
+        }
+    }
+
+    // Moves the viewport by (dx, dy) times its width without discarding the
+    // image: the finest finished layer is shifted and only the strips that
+    // became visible are rendered again. Falls back to invalidate() if the
+    // offset isn't a whole number of pixels of that layer.
+    void pan(vk::CommandBuffer commandBuffer, double dx, double dy) {
+        if (!hasImage()) {
+            invalidate();
+            return;
+        }
+
+        const size_t l = finishedLayer;
+        const auto e = pipeline[l]->extent;
+        const int w = e.width;
+        const int h = e.height;
+
+        // the viewport spans ws[l] * width pixels, see pushXYWH
+        const double sx = dx * ws[l] * w;
+        const double sy = dy * hs[l] * h;
+        const int ix = int(std::lround(sx));
+        const int iy = int(std::lround(sy));
+        if (std::abs(sx - ix) > panTolerance ||
+            std::abs(sy - iy) > panTolerance || 2 * std::abs(ix) >= w ||
+            2 * std::abs(iy) >= h) {
+            // not on the pixel grid, or mostly new anyway
+            invalidate();
+            return;
+        }
+        if (ix == 0 && iy == 0)
+            return;
+
+        shiftLayer(commandBuffer, l, ix, iy);
+        if (previewActive)
+            shiftPreview(commandBuffer, dx, dy);
+
+        // the finer layer in progress was based on the old image
         currentProg = 0;
+
+        vector<vk::Rect2D> shifted;
+        const auto add = [&](int x0, int y0, int x1, int y1) {
+            x0 = std::max(x0, 0);
+            y0 = std::max(y0, 0);
+            x1 = std::min(x1, w);
+            y1 = std::min(y1, h);
+            if (x0 < x1 && y0 < y1) {
+                shifted.push_back(vk::Rect2D(
+                    vk::Offset2D(x0, y0),
+                    vk::Extent2D(uint32_t(x1 - x0), uint32_t(y1 - y0))));
+            }
+        };
+
+        // strips that are still pending move along
+        for (const auto &r : dirty) {
+            const int x0 = r.offset.x - ix;
+            const int y0 = r.offset.y - iy;
+            add(x0, y0, x0 + int(r.extent.width), y0 + int(r.extent.height));
+        }
+
+        // pixel x shows what was at x + ix before, so the columns and rows
+        // past the old border are new
+        if (ix > 0)
+            add(w - ix, 0, w, h);
+        if (ix < 0)
+            add(0, 0, -ix, h);
+        const int cx0 = std::max(-ix, 0);
+        const int cx1 = w - std::max(ix, 0);
+        if (iy > 0)
+            add(cx0, h - iy, cx1, h);
+        if (iy < 0)
+            add(cx0, 0, cx1, -iy);
+
+        if (shifted.size() > maxDirtyRects) {
+            // merge them, long drags would collect lots of thin strips
+            vk::Rect2D box = shifted[0];
+            int x1 = box.offset.x + box.extent.width;
+            int y1 = box.offset.y + box.extent.height;
+            for (const auto &r : shifted) {
+                box.offset.x = std::min(box.offset.x, r.offset.x);
+                box.offset.y = std::min(box.offset.y, r.offset.y);
+                x1 = std::max(x1, int(r.offset.x + r.extent.width));
+                y1 = std::max(y1, int(r.offset.y + r.extent.height));
+            }
+            box.extent.width = x1 - box.offset.x;
+            box.extent.height = y1 - box.offset.y;
+            shifted = {box};
+        }
+
+        dirty = shifted;
     }
 
     void hardInvalidate() {
@@ -304,15 +498,33 @@ template <class DSL> class InterlacedRenderer {
         estim.reset();
     }
 
+    // false until the first layer after an invalidation is finished
+    bool hasImage() const { return finishedLayer < maxLayer; }
+
+    // False once the finest layer is finished and nothing was exposed or
+    // edited since, i.e. renderStep would not render anything. Reloaded
+    // pipelines only count once they are built, see reload().
+    bool needsFrame() const {
+        if (!dirty.empty() || finishedLayer > 0)
+            return true;
+        if (reloading.valid())
+            return reloading.wait_for(std::chrono::seconds(0)) ==
+                   std::future_status::ready;
+        return generation != shaderGeneration();
+    }
+
     void makeDP(Compositor &compositor) {
+        this->compositor = &compositor;
         for (size_t i = 0; i < maxLayer; i++) {
             presentationDescriptorPools.push_back(
-                compositor.makeDP(pipeline[i]->imageView()));
+                compositor.makeColorizeDP(pipeline[i]->imageView()));
         }
     }
 
+    // The layers only hold iteration counts, the colours are applied here.
+    // Therefore, changing them doesn't invalidate anything.
     void present(vk::CommandBuffer commandBuffer, Compositor &compositor,
-                 IRect r) {
+                 IRect r, const ColorUniformBufferObject &colors) {
         size_t i = std::min(maxLayer - 1, finishedLayer);
         if (i >= 0 && finishedLayer != maxLayer) {
             if (currentProg > 0) {
@@ -322,13 +534,33 @@ template <class DSL> class InterlacedRenderer {
         const auto x = pipeline[i]->imageLayout();
         pipeline[i]->beforeRead();
         compositor.setTransform(presentationDescriptorPools[i].get(), r);
-        compositor.draw(commandBuffer, presentationDescriptorPools[i].get());
+        compositor.drawColorized(commandBuffer,
+                                 presentationDescriptorPools[i].get(), colors);
+
+        // pixels of the preview without data are transparent
+        if (previewActive && previewSize < pixelSize(i)) {
+            assert(preview->imageLayout() ==
+                   vk::ImageLayout::eShaderReadOnlyOptimal);
+            compositor.setTransform(previewDescriptorPool.get(), r);
+            compositor.drawColorized(commandBuffer,
+                                     previewDescriptorPool.get(), colors);
+        } else {
+            previewActive = false;
+        }
     }
 
     void renderStep(const CommandBufferRecorder &rec,
                     vk::CommandBuffer commandBuffer,
                     const UniformBufferObject2 &ubo2, size_t bufferIndex) {
 
+        reload();
+        specialize(ubo2);
+
+        if (stencilPending) {
+            initStencil(rec, commandBuffer);
+            stencilPending = false;
+        }
+
         // fetch the last value before re-submitting it
         timer.fetch(bufferIndex);
 
@@ -354,17 +586,47 @@ template <class DSL> class InterlacedRenderer {
             // std::cout << formatBig(samples) << std::endl;
         }
 
-        int l = maxLayer - 1;
-        // TODO: Da muss eine barrier um das copyBufferLayer damit das
-        // funktioniert... (ich will hier mehrere Iterationen in einem Frame
-        // submitten. Vielleicht sollte der Renderer einen eigenen Puffer
-        // verwenden)
-        // while (samples >= pipeline[l]->extent.height * 2)
-        {
+        if (dirty.empty() && finishedLayer == 0)
+            return;
+
+        // The timer measures all layers of the frame at once, as the
+        // estimator predicts the samples of a whole frame
+        timer.start(commandBuffer, bufferIndex);
+        uint64_t rendered = 0;
+
+        // Strips exposed by pan() come first, as the finer layers are copied
+        // from this one. Columns are rendered like below.
+        while (!dirty.empty() && samples > 0) {
+            const size_t l = finishedLayer;
+            vk::Rect2D &r = dirty.back();
+            const uint32_t lines = uint32_t(std::clamp(
+                samples / int64_t(r.extent.height), int64_t(1),
+                int64_t(r.extent.width)));
+
+            vk::Rect2D scissor = r;
+            scissor.extent.width = lines;
+            r.offset.x += lines;
+            r.extent.width -= lines;
+            if (r.extent.width == 0)
+                dirty.pop_back();
+
+            const uint64_t effort = uint64_t(lines) * scissor.extent.height;
+            this->updateFragment(ubo2, l, MultiPipeMode::eSimple);
+            renderRect(rec, commandBuffer, l, MultiPipeMode::eSimple, scissor);
+            rendered += effort;
+            samples -= int64_t(effort);
+        }
 
-            if (finishedLayer == 0)
-                return;
+        // Refines layer after layer until the budget is spent. The blits in
+        // between are ordered by barriers (see copyBufferLayer), so all of
+        // them go into one submission. Another layer is only started if the
+        // budget covers two lines of it, but each frame makes some progress.
+        size_t l = std::min(finishedLayer, maxLayer - 1);
+        while (dirty.empty() && finishedLayer > 0) {
             l = finishedLayer - 1;
+            if (rendered > 0 &&
+                samples < int64_t(pipeline[l]->extent.height) * 2)
+                break;
 
             // TODO: sometimes you can still artifacts from the entry layer when
             // switching between presets!
@@ -389,14 +651,15 @@ template <class DSL> class InterlacedRenderer {
 
             if (mode != MultiPipeMode::eSimple && currentProg == 0) {
                 // MeasurePerformance("interlaced blit");
-                copyBufferLayer(l, l + 1);
+                copyBufferLayer(commandBuffer, l, l + 1);
                 // std::cout << "copied " << l << std::endl;
             }
 
             this->updateFragment(ubo2, l, mode);
-            const auto renderedSamples = this->renderStep(
-                rec, commandBuffer, l, bufferIndex, samples, mode);
+            const auto renderedSamples =
+                this->renderStep(rec, commandBuffer, l, samples, mode);
             samples -= renderedSamples;
+            rendered += renderedSamples;
             // std::cout << "rendered " << l << " with " << renderedSamples
             //           << std::endl;
 
@@ -409,6 +672,8 @@ template <class DSL> class InterlacedRenderer {
             }
         }
 
+        timer.stop(commandBuffer, bufferIndex, rendered);
+
         commitJS("setRenderParams",
                  "{currentProgress:" +
                      jsStrD(double(currentProg) / pipeline[l]->extent.width) +
@@ -419,57 +684,342 @@ template <class DSL> class InterlacedRenderer {
                      ",renderTime:" + jsStrD(renderTime) + "}");
     }
 
-    void copyBufferLayer(size_t i, size_t j) {
-        // j is src, i is dst
+    // Blits layer j into layer i. Recorded into the command buffer of the
+    // frame, the barriers order it after the rendering of layer j and before
+    // that of layer i.
+    void copyBufferLayer(vk::CommandBuffer commandBuffer, size_t i,
+                         size_t j) {
+        pipeline[j]->transition(commandBuffer,
+                                vk::ImageLayout::eTransferSrcOptimal);
+        pipeline[i]->transition(commandBuffer,
+                                vk::ImageLayout::eTransferDstOptimal);
+
+        std::array<vk::ImageBlit, 1> regions;
+        regions[0].srcOffsets[0].x = 0;
+        regions[0].srcOffsets[0].y = 0;
+        regions[0].srcOffsets[0].z = 0;
+        regions[0].srcOffsets[1].x = pipeline[j]->extent.width;
+        regions[0].srcOffsets[1].y = pipeline[j]->extent.height;
+        regions[0].srcOffsets[1].z = 1;
+        regions[0].srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        regions[0].srcSubresource.layerCount = 1;
+        regions[0].srcSubresource.mipLevel = 0;
+        regions[0].dstOffsets[0].x = 0;
+        regions[0].dstOffsets[0].y = 0;
+        regions[0].dstOffsets[0].z = 0;
+        regions[0].dstOffsets[1].x = pipeline[i]->extent.width;
+        regions[0].dstOffsets[1].y = pipeline[i]->extent.height;
+        regions[0].dstOffsets[1].z = 1;
+        regions[0].dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        regions[0].dstSubresource.layerCount = 1;
+        regions[0].dstSubresource.mipLevel = 0;
+
+        commandBuffer.blitImage(
+            pipeline[j]->image(), vk::ImageLayout::eTransferSrcOptimal,
+            pipeline[i]->image(), vk::ImageLayout::eTransferDstOptimal,
+            regions, vk::Filter::eNearest);
+
+        pipeline[j]->transition(commandBuffer,
+                                vk::ImageLayout::eShaderReadOnlyOptimal);
+        pipeline[i]->transition(commandBuffer,
+                                vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
 
-        pipeline[j]->transition(vk::ImageLayout::eTransferSrcOptimal);
-        pipeline[i]->transition(vk::ImageLayout::eTransferDstOptimal);
+    // Moves the content of layer l, such that pixel x shows what was at
+    // x + dx before. Pixels without a source keep their old values.
+    void shiftLayer(vk::CommandBuffer commandBuffer, size_t l, int dx,
+                    int dy) {
+        const auto e = pipeline[l]->extent;
 
-        // TODO: do all of this in one pipeline? all this "waitIdle"
-        // will take too much time! But, does it? MeasurePerformance
-        // says <2us
-        {
-            SingleTimeCommandManager manager(commandPool->renderer(),
-                                             *device->device,
-                                             *device->transferQueue);
+        vk::ImageCopy region{};
+        region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        region.srcSubresource.mipLevel = 0;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource = region.srcSubresource;
+        region.srcOffset = vk::Offset3D(std::max(dx, 0), std::max(dy, 0), 0);
+        region.dstOffset = vk::Offset3D(0, 0, 0);
+        region.extent = vk::Extent3D(e.width - std::abs(dx),
+                                     e.height - std::abs(dy), 1);
+
+        // The source and destination regions of a copy within the same image
+        // must not overlap. Therefore, go through the buffer image.
+        const auto buffer = scratch();
+        pipeline[l]->transition(commandBuffer,
+                                vk::ImageLayout::eTransferSrcOptimal);
+        buffer->transitionTo(commandBuffer,
+                             vk::ImageLayout::eTransferDstOptimal);
+        commandBuffer.copyImage(
+            pipeline[l]->image(), vk::ImageLayout::eTransferSrcOptimal,
+            buffer->image(), vk::ImageLayout::eTransferDstOptimal, region);
+
+        region.srcOffset = vk::Offset3D(0, 0, 0);
+        region.dstOffset = vk::Offset3D(std::max(-dx, 0), std::max(-dy, 0), 0);
+
+        pipeline[l]->transition(commandBuffer,
+                                vk::ImageLayout::eTransferDstOptimal);
+        buffer->transitionTo(commandBuffer,
+                             vk::ImageLayout::eTransferSrcOptimal);
+        commandBuffer.copyImage(
+            buffer->image(), vk::ImageLayout::eTransferSrcOptimal,
+            pipeline[l]->image(), vk::ImageLayout::eTransferDstOptimal, region);
+
+        pipeline[l]->transition(commandBuffer,
+                                vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
 
+    // Moves the preview along with pan(). It has the geometry of layer 0, so
+    // the offset is rounded to its pixels, or the preview is dropped if that
+    // isn't close enough. The pixels that became visible have no data.
+    void shiftPreview(vk::CommandBuffer commandBuffer, double dx, double dy) {
+        const auto e = pipeline[0]->extent;
+        const int w = e.width;
+        const int h = e.height;
+        const double sx = dx * ws[0] * w;
+        const double sy = dy * hs[0] * h;
+        const int ix = int(std::lround(sx));
+        const int iy = int(std::lround(sy));
+        if (std::abs(sx - ix) > panTolerance ||
+            std::abs(sy - iy) > panTolerance || std::abs(ix) >= w ||
+            std::abs(iy) >= h) {
+            previewActive = false;
+            return;
+        }
+        if (ix == 0 && iy == 0)
+            return;
+
+        // Assembled in the scratch image, like shiftLayer. It starts without
+        // data, see resamplePreview.
+        const auto buffer = scratch();
+        buffer->transitionTo(commandBuffer,
+                             vk::ImageLayout::eTransferDstOptimal);
+        vk::ImageSubresourceRange range{};
+        range.aspectMask = vk::ImageAspectFlagBits::eColor;
+        range.levelCount = 1;
+        range.layerCount = 1;
+        commandBuffer.clearColorImage(
+            buffer->image(), vk::ImageLayout::eTransferDstOptimal,
+            vk::ClearColorValue(std::array<float, 4>({-1.f, 0.f, 0.f, 0.f})),
+            range);
+
+        vk::ImageCopy region{};
+        region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource = region.srcSubresource;
+        region.srcOffset = vk::Offset3D(std::max(ix, 0), std::max(iy, 0), 0);
+        region.dstOffset = vk::Offset3D(std::max(-ix, 0), std::max(-iy, 0), 0);
+        region.extent = vk::Extent3D(w - std::abs(ix), h - std::abs(iy), 1);
+
+        preview->transitionTo(commandBuffer,
+                              vk::ImageLayout::eTransferSrcOptimal);
+        commandBuffer.copyImage(
+            preview->image(), vk::ImageLayout::eTransferSrcOptimal,
+            buffer->image(), vk::ImageLayout::eTransferDstOptimal, region);
+
+        region.srcOffset = vk::Offset3D(0, 0, 0);
+        region.dstOffset = vk::Offset3D(0, 0, 0);
+        region.extent = vk::Extent3D(w, h, 1);
+
+        buffer->transitionTo(commandBuffer,
+                             vk::ImageLayout::eTransferSrcOptimal);
+        preview->transitionTo(commandBuffer,
+                              vk::ImageLayout::eTransferDstOptimal);
+        commandBuffer.copyImage(
+            buffer->image(), vk::ImageLayout::eTransferSrcOptimal,
+            preview->image(), vk::ImageLayout::eTransferDstOptimal, region);
+
+        preview->transitionTo(commandBuffer,
+                              vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
+    // Scratch image with the size of the first (largest) layer, created on
+    // the first use. Copies within one image must not overlap, so shifting
+    // and resampling go through it.
+    shared_ptr<OnlineTexture> scratch() {
+        if (!panBuffer.get()) {
+            panBuffer = make_shared<OnlineTexture>(
+                device, commandPool->transfer(), pipeline[0]->extent.width,
+                pipeline[0]->extent.height,
+                vk::ImageUsageFlagBits::eTransferSrc,
+                MultiPipe<DSL>::imageFormat);
+        }
+        return panBuffer;
+    }
+
+    // Pixel (i, j) of layer l samples the texture coordinate
+    // origin(l) + (i + 0.5, j + 0.5) * pitch(l), see updatePerspective
+    glm::dvec2 pitch(size_t l) const {
+        return glm::dvec2(1. / (ws[l] * pipeline[l]->extent.width),
+                          1. / (hs[l] * pipeline[l]->extent.height));
+    }
+    glm::dvec2 origin(size_t l) const {
+        return glm::dvec2((1. + xs[l] - 1. / ws[l]) * .5,
+                          (1. + ys[l] - 1. / hs[l]) * .5);
+    }
+
+    // edge length of the pixels of layer l in pixels of layer 0
+    double pixelSize(size_t l) const {
+        return std::max(
+            pipeline[0]->extent.width / double(pipeline[l]->extent.width),
+            pipeline[0]->extent.height / double(pipeline[l]->extent.height));
+    }
+
+    // After zoom(scale, dx, dy), pixel p of layer n samples the same point as
+    // pixel alpha * p + beta of layer m did before
+    void mapPixels(size_t n, size_t m, double scale, double dx, double dy,
+                   glm::dvec2 &alpha, glm::dvec2 &beta) const {
+        const glm::dvec2 d(dx, dy);
+        alpha = pitch(n) * scale / pitch(m);
+        beta = ((origin(n) + .5 * pitch(n)) * scale + d - origin(m)) /
+                   pitch(m) -
+               .5;
+    }
+
+    // Fills the preview with the old image of layer b (or the old preview),
+    // moved by the pixel mapping. The rest has no data.
+    void resamplePreview(vk::CommandBuffer commandBuffer, bool fromPreview,
+                         size_t b, glm::dvec2 alpha, glm::dvec2 beta) {
+        vk::Image src;
+        Extent2D srcExtent;
+        if (fromPreview) {
+            // can't blit within the same image
+            const auto buffer = scratch();
+            preview->transitionTo(commandBuffer,
+                                  vk::ImageLayout::eTransferSrcOptimal);
+            buffer->transitionTo(commandBuffer,
+                                 vk::ImageLayout::eTransferDstOptimal);
+
+            vk::ImageCopy region{};
+            region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            region.srcSubresource.layerCount = 1;
+            region.dstSubresource = region.srcSubresource;
+            region.extent = vk::Extent3D(pipeline[0]->extent.width,
+                                         pipeline[0]->extent.height, 1);
+            commandBuffer.copyImage(
+                preview->image(), vk::ImageLayout::eTransferSrcOptimal,
+                buffer->image(), vk::ImageLayout::eTransferDstOptimal,
+                region);
+
+            buffer->transitionTo(commandBuffer,
+                                 vk::ImageLayout::eTransferSrcOptimal);
+            src = buffer->image();
+            srcExtent = pipeline[0]->extent;
+        } else {
+            pipeline[b]->transition(commandBuffer,
+                                    vk::ImageLayout::eTransferSrcOptimal);
+            src = pipeline[b]->image();
+            srcExtent = pipeline[b]->extent;
+        }
+
+        preview->transitionTo(commandBuffer,
+                              vk::ImageLayout::eTransferDstOptimal);
+
+        // negative counts mark pixels without data, see colorize.frag
+        vk::ImageSubresourceRange range{};
+        range.aspectMask = vk::ImageAspectFlagBits::eColor;
+        range.levelCount = 1;
+        range.layerCount = 1;
+        commandBuffer.clearColorImage(
+            preview->image(), vk::ImageLayout::eTransferDstOptimal,
+            vk::ClearColorValue(std::array<float, 4>({-1.f, 0.f, 0.f, 0.f})),
+            range);
+
+        // The blit maps the edges of the regions onto each other, i.e.
+        // the destination coordinate x to alpha * x + c. Only the part
+        // within the source is copied. Rounding the regions to whole
+        // pixels is good enough for a preview.
+        const glm::dvec2 c = beta + .5 - .5 * alpha;
+        const glm::dvec2 size(pipeline[0]->extent.width,
+                              pipeline[0]->extent.height);
+        const glm::dvec2 srcSize(srcExtent.width, srcExtent.height);
+        const glm::dvec2 x0 = glm::max(glm::dvec2(0.), glm::ceil(-c / alpha));
+        const glm::dvec2 x1 = glm::min(size, glm::floor((srcSize - c) / alpha));
+        const glm::dvec2 u0 =
+            glm::clamp(glm::round(alpha * x0 + c), glm::dvec2(0.), srcSize);
+        const glm::dvec2 u1 =
+            glm::clamp(glm::round(alpha * x1 + c), glm::dvec2(0.), srcSize);
+
+        if (x0.x < x1.x && x0.y < x1.y && u0.x < u1.x && u0.y < u1.y) {
             std::array<vk::ImageBlit, 1> regions;
-            regions[0].srcOffsets[0].x = 0;
-            regions[0].srcOffsets[0].y = 0;
-            regions[0].srcOffsets[0].z = 0;
-            regions[0].srcOffsets[1].x = pipeline[j]->extent.width;
-            regions[0].srcOffsets[1].y = pipeline[j]->extent.height;
-            regions[0].srcOffsets[1].z = 1;
+            regions[0].srcOffsets[0] = vk::Offset3D(int(u0.x), int(u0.y), 0);
+            regions[0].srcOffsets[1] = vk::Offset3D(int(u1.x), int(u1.y), 1);
             regions[0].srcSubresource.aspectMask =
                 vk::ImageAspectFlagBits::eColor;
             regions[0].srcSubresource.layerCount = 1;
             regions[0].srcSubresource.mipLevel = 0;
-            regions[0].dstOffsets[0].x = 0;
-            regions[0].dstOffsets[0].y = 0;
-            regions[0].dstOffsets[0].z = 0;
-            regions[0].dstOffsets[1].x = pipeline[i]->extent.width;
-            regions[0].dstOffsets[1].y = pipeline[i]->extent.height;
-            regions[0].dstOffsets[1].z = 1;
-            regions[0].dstSubresource.aspectMask =
-                vk::ImageAspectFlagBits::eColor;
-            regions[0].dstSubresource.layerCount = 1;
-            regions[0].dstSubresource.mipLevel = 0;
+            regions[0].dstOffsets[0] = vk::Offset3D(int(x0.x), int(x0.y), 0);
+            regions[0].dstOffsets[1] = vk::Offset3D(int(x1.x), int(x1.y), 1);
+            regions[0].dstSubresource = regions[0].srcSubresource;
 
-            manager.commandBuffers[0].blitImage(
-                pipeline[j]->image(), vk::ImageLayout::eTransferSrcOptimal,
-                pipeline[i]->image(), vk::ImageLayout::eTransferDstOptimal,
+            commandBuffer.blitImage(
+                src, vk::ImageLayout::eTransferSrcOptimal,
+                preview->image(), vk::ImageLayout::eTransferDstOptimal,
                 regions, vk::Filter::eNearest);
         }
 
-        // Doing this in the same buffer interfers with blitImage
-        pipeline[j]->transition(vk::ImageLayout::eShaderReadOnlyOptimal);
-        pipeline[i]->transition(vk::ImageLayout::eShaderReadOnlyOptimal);
+        preview->transitionTo(commandBuffer,
+                              vk::ImageLayout::eShaderReadOnlyOptimal);
+        if (!fromPreview) {
+            pipeline[b]->transition(commandBuffer,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal);
+        }
+    }
+
+    // If the pixels of a layer map 1:1 onto pixels of the old layer b, e.g.
+    // after zooming in by a power of two, copies them and continues refining
+    // from there. Only layers that are covered completely are used.
+    void reuseExactLayer(vk::CommandBuffer commandBuffer, size_t b,
+                         double scale, double dx, double dy) {
+        // the finest one reuses the most
+        for (size_t l = 0; l < maxLayer; l++) {
+            if (l == b)
+                continue;
+
+            glm::dvec2 alpha, beta;
+            mapPixels(l, b, scale, dx, dy, alpha, beta);
+            const glm::dvec2 offset = glm::round(beta);
+            if (glm::any(glm::greaterThan(glm::abs(alpha - 1.),
+                                          glm::dvec2(panTolerance))) ||
+                glm::any(glm::greaterThan(glm::abs(beta - offset),
+                                          glm::dvec2(panTolerance)))) {
+                continue;
+            }
+
+            const auto e = pipeline[l]->extent;
+            const auto src = pipeline[b]->extent;
+            if (offset.x < 0 || offset.y < 0 ||
+                offset.x + e.width > src.width ||
+                offset.y + e.height > src.height) {
+                continue;
+            }
+
+            vk::ImageCopy region{};
+            region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            region.srcSubresource.layerCount = 1;
+            region.dstSubresource = region.srcSubresource;
+            region.srcOffset = vk::Offset3D(int(offset.x), int(offset.y), 0);
+            region.extent = vk::Extent3D(e.width, e.height, 1);
+
+            pipeline[b]->transition(commandBuffer,
+                                    vk::ImageLayout::eTransferSrcOptimal);
+            pipeline[l]->transition(commandBuffer,
+                                    vk::ImageLayout::eTransferDstOptimal);
+            commandBuffer.copyImage(
+                pipeline[b]->image(), vk::ImageLayout::eTransferSrcOptimal,
+                pipeline[l]->image(), vk::ImageLayout::eTransferDstOptimal,
+                region);
+            pipeline[b]->transition(commandBuffer,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal);
+            pipeline[l]->transition(commandBuffer,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal);
+
+            finishedLayer = l;
+            return;
+        }
     }
 
     uint64_t renderStep(const CommandBufferRecorder &rec,
                         vk::CommandBuffer commandBuffer, size_t l,
-                        size_t bufferIndex, uint64_t effort,
-                        MultiPipeMode mode) {
+                        uint64_t effort, MultiPipeMode mode) {
         checkLayer(l);
 
         const auto e = pipeline[l]->extent;
@@ -490,7 +1040,28 @@ template <class DSL> class InterlacedRenderer {
         if (l != maxLayer - 1) {
             effort /= 2;
         }
-        timer.start(commandBuffer, bufferIndex, effort);
+
+        vk::Rect2D scissor;
+        scissor.offset.x = currentProg;
+        scissor.offset.y = 0;
+        scissor.extent.width = lines;
+        scissor.extent.height = pipeline[l]->extent.height;
+        currentProg += lines;
+        assert(currentProg <= pipeline[l]->extent.width);
+
+        renderRect(rec, commandBuffer, l, mode, scissor);
+
+        return effort;
+    }
+
+    // renders the part of layer l within the scissor
+    void renderRect(const CommandBufferRecorder &rec,
+                    vk::CommandBuffer commandBuffer, size_t l,
+                    MultiPipeMode mode, const vk::Rect2D &scissor) {
+        if (backend == RenderBackend::eCompute) {
+            pipeline[l]->dispatch(commandBuffer, interlace(l, mode, scissor));
+            return;
+        }
         {
             const auto rpm = this->makeRPM(rec, l, mode);
 
@@ -503,14 +1074,6 @@ template <class DSL> class InterlacedRenderer {
 
             pipeline[l]->bind(commandBuffer, mode);
 
-            vk::Rect2D scissor;
-            scissor.offset.x = currentProg;
-            scissor.offset.y = 0;
-            scissor.extent.width = lines;
-            scissor.extent.height = pipeline[l]->extent.height;
-            currentProg += lines;
-            assert(currentProg <= pipeline[l]->extent.width);
-
             commandBuffer.setScissor(0, 1, &scissor);
 
             vkCmdDrawIndexed(
@@ -522,11 +1085,42 @@ template <class DSL> class InterlacedRenderer {
                 0  // first instance
             );
         }
-        timer.stop(commandBuffer, bufferIndex);
+        // The render pass only waits for earlier commands. Make its writes
+        // visible to the blits and to the compositor.
+        pipeline[l]->transition(commandBuffer,
+                                vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
 
-        return effort;
+    // The pixels of layer l within the scissor that the mode renders. In
+    // eStencilRead mode, every other column (or row, for odd l) was copied
+    // from layer l + 1, see initStencil. The even ones are new.
+    ComputeInterlace interlace(size_t l, MultiPipeMode mode,
+                               const vk::Rect2D &scissor) const {
+        glm::ivec2 stride(1);
+        if (mode == MultiPipeMode::eStencilRead) {
+            // even layers have twice the width of the next one
+            if (l % 2 == 0)
+                stride.x = 2;
+            else
+                stride.y = 2;
+        }
+
+        const glm::ivec2 begin(scissor.offset.x, scissor.offset.y);
+        const glm::ivec2 end =
+            begin + glm::ivec2(scissor.extent.width, scissor.extent.height);
+        const glm::ivec2 first = (begin + stride - 1) / stride * stride;
+
+        ComputeInterlace c{};
+        c.origin = glm::vec2(origin(l));
+        c.pitch = glm::vec2(pitch(l));
+        c.offset = first;
+        c.stride = stride;
+        c.count = glm::max((end - first + stride - 1) / stride, glm::ivec2(0));
+        return c;
     }
 
+    RenderBackend getBackend() const { return backend; }
+
     Extent2D getExtent(size_t i = 0) {
         checkLayer(i);
         return pipeline[i]->getExtent();
@@ -540,12 +1134,165 @@ template <class DSL> class InterlacedRenderer {
     void updateFragment(const UniformBufferObject2 &ubo, size_t i,
                         MultiPipeMode mode) {
         checkLayer(i);
-        pipeline[i]->updateFragment(ubo, mode);
+        pipeline[i]->updateFragment(commandPool->current(), ubo, mode);
+    }
+
+    // Binds a buffer (e.g. the reference orbit) to all layers. Descriptor
+    // sets of pending frames must not change, see CommandPool::waitPending.
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range) {
+        for (size_t i = 0; i < maxLayer; i++) {
+            pipeline[i]->updateStorage(binding, buffer, range);
+        }
     }
 
   private:
     inline void checkLayer(size_t i) { assert(i < maxLayer); }
 
+    // builds pipelines of this shader, see reload and specialize
+    std::shared_future<Variant> buildVariant(Specialization constants) {
+        return buildVariant(device, backend, fractalShader, extent,
+                            constants);
+    }
+
+    // Drops a variant that isn't needed anymore. Pending frames may still
+    // use a built one, so it is retired until their fences signaled.
+    // Destroying the last future of std::async waits for the thread, so
+    // unfinished ones are parked in discarded instead.
+    void drop(std::shared_future<Variant> variant) {
+        if (variant.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready)
+            commandPool->retire(make_shared<Variant>(variant.get()));
+        else
+            discarded.push_back(std::move(variant));
+    }
+    // The parked variants were never used by a frame
+    void dropDiscarded() {
+        for (auto i = discarded.begin(); i != discarded.end();) {
+            if (i->wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready)
+                i = discarded.erase(i);
+            else
+                i++;
+        }
+    }
+
+    // true while a specialization is compiled, see specialize
+    bool specializing() const {
+        for (const auto &[s, variant] : variants) {
+            if (variant.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::ready)
+                return true;
+        }
+        return false;
+    }
+
+    void usePipelines(const Variant &v) {
+        // The descriptor sets of the layers work with every variant, the
+        // layouts are the same
+        for (auto &p : pipeline) {
+            if (v.compute)
+                p->usePipeline(v.compute);
+            else
+                p->usePipelines(v.graphics);
+        }
+    }
+
+    // Builds the pipelines again once the shaders were edited, see
+    // shaderGeneration. Compiling happens on another thread, the layers keep
+    // the old pipelines until the new ones are ready, then all are swapped at
+    // once between two frames. If the shader doesn't compile, the old ones
+    // just stay until the next edit.
+    void reload() {
+        if (!reloading.valid()) {
+            const uint64_t g = shaderGeneration();
+            if (g != generation) {
+                generation = g;
+                reloading = buildVariant({});
+            }
+            return;
+        }
+        if (reloading.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+            return;
+
+        const Variant v = reloading.get();
+        reloading = {};
+        if (!v.graphics && !v.compute)
+            return;
+
+        // Pending frames may still use the old pipelines, they are released
+        // once the fences of those frames signaled
+        commandPool->retire(make_shared<Variant>(Variant{graphics, compute}));
+        graphics = v.graphics;
+        compute = v.compute;
+        // specialized from the old source, retired as well
+        for (auto &[s, variant] : variants)
+            drop(variant);
+        variants.clear();
+        dropDiscarded();
+        active.reset();
+
+        usePipelines(v);
+        invalidate();
+    }
+
+    // Uses the pipelines specialized for the parameters of ubo2 once they
+    // are built, the generic ones until then. Only while play is 0, the
+    // generic shaders branch on it in the inner loop.
+    //
+    // Dragging the iterations changes them every frame, so only one
+    // specialization is built at a time. Whatever is wanted once it is done
+    // is built next, the values in between are skipped.
+    void specialize(const UniformBufferObject2 &ubo2) {
+        optional<FractalSpecialization> wanted;
+        if (ubo2.play == 0)
+            wanted = FractalSpecialization{ubo2.iter, ubo2.radius};
+
+        optional<FractalSpecialization> use;
+        if (wanted.has_value()) {
+            auto it = variants.find(wanted.value());
+            if (it == variants.end() && !specializing()) {
+                if (variants.size() >= maxVariants) {
+                    for (auto i = variants.begin(); i != variants.end();) {
+                        if (active.has_value() && i->first == active.value()) {
+                            i++;
+                        } else {
+                            drop(i->second);
+                            i = variants.erase(i);
+                        }
+                    }
+                    dropDiscarded();
+                }
+                it = variants
+                         .emplace(wanted.value(),
+                                  buildVariant(wanted.value().constants()))
+                         .first;
+            }
+            // the generic pipelines until it is built
+            if (it != variants.end() &&
+                it->second.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready &&
+                (it->second.get().graphics || it->second.get().compute))
+                use = wanted;
+        }
+
+        if (use == active)
+            return;
+        active = use;
+
+        // still alive in variants for pending frames
+        usePipelines(use.has_value() ? variants.at(use.value()).get()
+                                     : Variant{graphics, compute});
+    }
+
+    // starts over at the coarsest layer, but keeps the preview
+    void restart() {
+        finishedLayer = maxLayer;
+        currentProg = 0;
+        dirty.clear();
+    }
+
     shared_ptr<FractalRenderPassManager>
     makeRPM(const CommandBufferRecorder &rec, size_t i, MultiPipeMode mode) {
         checkLayer(i);
@@ -563,7 +1310,7 @@ template <class DSL> class InterlacedRenderer {
         ubo.proj = glm::mat4(1.0f);
         ubo.proj[0][0] *= -1;
 
-        pipeline[i]->updateVertex(ubo, mode);
+        pipeline[i]->updateVertex(commandPool->current(), ubo, mode);
     }
 
   private:
@@ -576,6 +1323,25 @@ template <class DSL> class InterlacedRenderer {
     shared_ptr<CommandPool> commandPool;
 
     vector<shared_ptr<MultiPipe<DSL>>> pipeline;
+    // see initStencil
+    bool stencilPending = false;
+
+    const RenderBackend backend;
+    // shared by all layers of the graphics or the compute backend
+    shared_ptr<MultiPipeline<DSL>> graphics;
+    shared_ptr<ComputePipeline> compute;
+
+    // specialized pipelines, see specialize
+    const path fractalShader;
+    std::map<FractalSpecialization, std::shared_future<Variant>> variants;
+    // the variant the layers use, the generic pipelines if none
+    optional<FractalSpecialization> active;
+    static constexpr size_t maxVariants = 4;
+    vector<std::shared_future<Variant>> discarded;
+
+    // shaderGeneration the generic pipelines were built from, see reload
+    uint64_t generation = shaderGeneration();
+    std::shared_future<Variant> reloading;
 
     vector<shared_ptr<DescriptorPool>> presentationDescriptorPools;
 
@@ -590,5 +1356,26 @@ template <class DSL> class InterlacedRenderer {
     size_t maxLayer = 0;
     size_t currentProg = 0;
 
+    // parts of layer finishedLayer that have to be rendered again after pan()
+    vector<vk::Rect2D> dirty;
+    static constexpr size_t maxDirtyRects = 8;
+    // each strip updates the uniform buffers of the layer once, see
+    // renderStep
+    static_assert(maxDirtyRects + 2 <= uniformSlotsPerFrame);
+    // offsets closer to whole pixels are good enough to keep the image
+    static constexpr double panTolerance = 1e-3;
+    // see scratch
+    shared_ptr<OnlineTexture> panBuffer;
+
+    // Image of the previous view after zoom(), with the geometry of layer 0.
+    // Created on the first zoom.
+    shared_ptr<OnlineTexture> preview;
+    shared_ptr<DescriptorPool> previewDescriptorPool;
+    bool previewActive = false;
+    // edge length of its pixels in pixels of layer 0
+    double previewSize = 1.;
+
+    Compositor *compositor = nullptr;
+
     EffortEstimator estim;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "logicalDevice.h"
+#include "../shaderc/database.h"
 
 vk::raii::Device LogicalDevice::createDevice() {
     // https://vulkan-tutorial.com/en/Drawing_a_triangle/Setup/Logical_device_and_queues
@@ -45,12 +46,16 @@ vk::raii::Device LogicalDevice::createDevice() {
     pNext = (const void **)&vulkan11features.pNext;
     */
 
-    // we want anisotropy and 64 bits
+    // we want anisotropy and 64 bits. Without doubles, only the float
+    // shaders can be used (see PrecisionSelector).
     vk::PhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
-    deviceFeatures.shaderFloat64 = VK_TRUE;
-    deviceFeatures.shaderInt64 = VK_TRUE;
-    deviceFeatures.shaderInt16 = VK_TRUE;
+    deviceFeatures.shaderFloat64 = physical->features.shaderFloat64;
+    deviceFeatures.shaderInt64 = physical->features.shaderInt64;
+    deviceFeatures.shaderInt16 = physical->features.shaderInt16;
+    // rg32f images for the compute backend of the fractals
+    deviceFeatures.shaderStorageImageExtendedFormats =
+        physical->features.shaderStorageImageExtendedFormats;
     createInfo.pEnabledFeatures = &deviceFeatures;
 
     // enable extensions
@@ -72,4 +77,70 @@ vk::raii::Device LogicalDevice::createDevice() {
 
     // TODO: does this work without destroying it?
     return physical->device.createDevice(createInfo);
-}
\ No newline at end of file
+}
+
+// The cache only fits the driver that wrote it. The driver checks the header,
+// too, but not all of them do so reliably, and a separate entry for each
+// device keeps the caches of several GPUs from overwriting each other.
+path LogicalDevice::pipelineCachePath() const {
+    const auto &p = physical->properties;
+    const char *digits = "0123456789abcdef";
+    string uuid;
+    for (size_t i = 0; i < VK_UUID_SIZE; i++) {
+        uuid += digits[p.pipelineCacheUUID[i] >> 4];
+        uuid += digits[p.pipelineCacheUUID[i] & 15];
+    }
+    return "pipelines-" + uuid + "-" + std::to_string(p.driverVersion) +
+           ".cache";
+}
+
+bool LogicalDevice::isCompatiblePipelineCache(
+    const vector<uint8_t> &data) const {
+    // see VkPipelineCacheHeaderVersionOne
+    const size_t headerSize = 16 + VK_UUID_SIZE;
+    if (data.size() < headerSize)
+        return false;
+
+    uint32_t header[4];
+    memcpy(header, data.data(), sizeof(header));
+    const auto &p = physical->properties;
+    return header[0] >= headerSize &&
+           header[1] == uint32_t(vk::PipelineCacheHeaderVersion::eOne) &&
+           header[2] == p.vendorID && header[3] == p.deviceID &&
+           memcmp(data.data() + 16, p.pipelineCacheUUID.data(),
+                  VK_UUID_SIZE) == 0;
+}
+
+vk::raii::PipelineCache LogicalDevice::createPipelineCache() {
+    createFatouDB();
+
+    vector<uint8_t> data;
+    const path file = pipelineCachePath();
+    if (fatouDB->fileExists(file)) {
+        data = fatouDB->getFile(file);
+        if (!isCompatiblePipelineCache(data)) {
+            std::cerr << "Ignoring incompatible pipeline cache" << std::endl;
+            data.clear();
+        }
+    }
+
+    vk::PipelineCacheCreateInfo createInfo{};
+    createInfo.sType = vk::StructureType::ePipelineCacheCreateInfo;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+    return device.createPipelineCache(createInfo);
+}
+
+void LogicalDevice::savePipelineCache() {
+    try {
+        const vector<uint8_t> data = pipelineCache.getData();
+        if (data.size() == savedPipelineCacheSize)
+            return;
+        fatouDB->storeFile(pipelineCachePath(), data);
+        savedPipelineCacheSize = data.size();
+    } catch (std::exception &e) {
+        // only slows down the next start
+        std::cerr << "Couldn't save the pipeline cache: " << e.what()
+                  << std::endl;
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "physicalDevice.h"
+#include "allocator.h"
 #include <iostream>
 class LogicalDevice : private boost::noncopyable {
   public:
@@ -11,13 +12,27 @@ class LogicalDevice : private boost::noncopyable {
           // simply use index 0.
           transferQueue(device.getQueue(indices.transferFamily.value(), 0)),
           graphicsQueue(device.getQueue(indices.graphicsFamily.value(), 0)),
-          presentQueue(device.getQueue(indices.presentFamily.value(), 0)) {}
+          presentQueue(device.getQueue(indices.presentFamily.value(), 0)),
+          pipelineCache(createPipelineCache()),
+          allocator(make_unique<MemoryAllocator>(*this)) {
+        savedPipelineCacheSize = pipelineCache.getData().size();
+    }
 
-    ~LogicalDevice() { std::cout << "Destroy Logical device..." << std::endl; }
+    ~LogicalDevice() {
+        savePipelineCache();
+        std::cout << "Destroy Logical device..." << std::endl;
+    }
 
     vk::Device handle() const { return static_cast<vk::Device>(*device); }
 
-    void waitIdle() { device.waitIdle(); }
+    void waitIdle() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        device.waitIdle();
+    }
+
+    // Writes the pipeline cache to fatouDB, if pipelines were added since it
+    // was loaded or last saved
+    void savePipelineCache();
 
   public:
     // TODO: private!
@@ -28,6 +43,24 @@ class LogicalDevice : private boost::noncopyable {
     const vk::raii::Queue presentQueue;
     const vk::raii::Queue transferQueue;
 
+    // Queues must not be used by two threads at once, and the queues above
+    // may all be the same. Held for submits, presents and waits only, so CEF
+    // can upload the GUI while the render loop records its frame.
+    inline static std::mutex queueMutex;
+
+    // Passed to all pipeline creations. Compiling the shaders for a pipeline
+    // is expensive and all layers of all fractals share few of them, so this
+    // makes resizing cheap. It is stored across program executions.
+    const vk::raii::PipelineCache pipelineCache;
+
+    // memory of all buffers and images
+    const unique_ptr<MemoryAllocator> allocator;
+
   private:
     vk::raii::Device createDevice();
+    vk::raii::PipelineCache createPipelineCache();
+    path pipelineCachePath() const;
+    bool isCompatiblePipelineCache(const vector<uint8_t> &data) const;
+
+    size_t savedPipelineCacheSize = 0;
 };
\ No newline at end of file
@@ -7,9 +7,9 @@
 Navigator navi;
 
 void Navigator::updateXYZ() {
-    commitJS("setZ", jsStrD(z));
-    commitJS("setX", jsStrD(x));
-    commitJS("setY", jsStrD(y));
+    commitJS("setZ", jsStrD(z.log2()));
+    commitJS("setX", jsStrD(toDouble(x)));
+    commitJS("setY", jsStrD(toDouble(y)));
 }
 
 void Navigator::onScroll(int x, int y, double dx, double dy) {
@@ -24,13 +24,19 @@ void Navigator::onScroll(int x, int y, double dx, double dy) {
             z *= (1 - de);
         }
 
-        commitJS("setZ", jsStrD(z));
+        commitJS("setZ", jsStrD(z.log2()));
     }
 }
 
-void Navigator::getAdjustedPos(double &ax, double &ay) {
-    ax = -x - z * 0.5;
-    ay = y - z * 0.5;
+void Navigator::getAdjustedPos(HighPrecision &ax, HighPrecision &ay) const {
+    const HighPrecision half = (z * 0.5).toHighPrecision();
+    ax = -x - half;
+    ay = y - half;
+}
+
+void Navigator::getCenter(HighPrecision &cx, HighPrecision &cy) const {
+    cx = -x;
+    cy = y;
 }
 
 void Navigator::onDown(int x, int y) {
@@ -53,11 +59,11 @@ void Navigator::onMove(int mx, int my) {
         float ax = std::max(1.0f, ih / float(iw));
         float ay = std::max(1.0f, iw / float(ih));
 
-        x = x0 + dx * z / (iw * ax);
-        y = y0 - dy * z / (ih * ay);
+        x = x0 + (z * (dx / (iw * ax))).toHighPrecision();
+        y = y0 - (z * (dy / (ih * ay))).toHighPrecision();
 
-        commitJS("setX", jsStrD(x));
-        commitJS("setY", jsStrD(y));
+        commitJS("setX", jsStrD(toDouble(x)));
+        commitJS("setY", jsStrD(toDouble(y)));
     }
 }
 
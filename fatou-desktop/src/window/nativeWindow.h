@@ -5,6 +5,8 @@
 
 #include "pingable.h"
 #include "vulkanInstance.h"
+#include "highPrecision.h"
+#include "floatExp.h"
 
 double thisMonitorZoom(HWND hWnd);
 HWND getNativeFromGLFW(GLFWwindow *window);
@@ -29,15 +31,22 @@ class Navigator {
 
     void updateXYZ();
 
-    void getAdjustedPos(double &ax, double &ay);
+    // lower left corner of the viewport in the complex plane (exact)
+    void getAdjustedPos(HighPrecision &ax, HighPrecision &ay) const;
 
-  public:
-    double z;
-    double x;
-    double y;
+    // center of the viewport in the complex plane (exact)
+    void getCenter(HighPrecision &cx, HighPrecision &cy) const;
 
-    double x0;
-    double y0;
+  public:
+    // FloatExp, because doubles end at 1e-308
+    FloatExp z;
+    // x and y must not be doubles, otherwise deep zooms would snap to the
+    // next representable double
+    HighPrecision x;
+    HighPrecision y;
+
+    HighPrecision x0;
+    HighPrecision y0;
     int mx0;
     int my0;
 
@@ -75,6 +84,8 @@ class NativeWindow : public Pingable,
     vk::SurfaceKHR getSurface() { return surface; }
 
     void waitEvents() { glfwWaitEvents(); }
+    // in seconds
+    void waitEvents(double timeout) { glfwWaitEventsTimeout(timeout); }
 
     bool active() { return glfwWindowShouldClose(window); }
     void poll() { glfwPollEvents(); }
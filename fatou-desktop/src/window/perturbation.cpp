@@ -0,0 +1,395 @@
+#include "perturbation.h"
+#include "sharedTexture.h"
+#include "../gui/cef/js.h"
+
+#include <chrono>
+#include <cmath>
+
+static inline glm::dvec2 imMul(glm::dvec2 a, glm::dvec2 b) {
+    return glm::dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+static inline double magnitudeSquared(glm::dvec2 a) {
+    return a.x * a.x + a.y * a.y;
+}
+
+ReferenceOrbit::ReferenceOrbit(const HighPrecision &cx, const HighPrecision &cy,
+                               const FloatExp &zoom, int maxIter,
+                               double bailout)
+    : cx(cx), cy(cy), bits(availableBits(requiredBits(zoom))),
+      maxIter(maxIter), bailout(bailout) {
+    switch (bits) {
+    case 128:
+        iterate<128>();
+        break;
+    case 256:
+        iterate<256>();
+        break;
+    case 512:
+        iterate<512>();
+        break;
+    case 1024:
+        iterate<1024>();
+        break;
+    default:
+        iterate<2048>();
+        break;
+    }
+}
+
+unsigned ReferenceOrbit::availableBits(unsigned bits) {
+    // cpp_bin_float needs the precision at compile time, so we pick the
+    // smallest one that is sufficient. 128 bits are ~4x faster than 512.
+    // This also means the orbit can be reused until the zoom leaves the tier.
+    for (const unsigned b : {128u, 256u, 512u, 1024u}) {
+        if (bits <= b)
+            return b;
+    }
+    return 2048;
+}
+
+unsigned ReferenceOrbit::requiredBits(const FloatExp &zoom) {
+    // one bit per halving of the viewport plus enough to keep the orbit exact
+    // in double precision for a lot of iterations
+    const double depth = std::max(0.0, -zoom.log2());
+    return 64 + unsigned(std::ceil(depth));
+}
+
+template <unsigned Bits> void ReferenceOrbit::iterate() {
+    using Real = FixedPrecision<Bits>;
+
+    const Real x0(cx);
+    const Real y0(cy);
+    Real x = 0;
+    Real y = 0;
+
+    // the shader always reads Z_{n+1}, so there must be at least two points
+    const int n = std::max(1, maxIter) + 1;
+    points.reserve(n);
+
+    for (int i = 0; i < n; i++) {
+        const glm::dvec2 p(x.template convert_to<double>(),
+                           y.template convert_to<double>());
+        points.push_back(p);
+
+        if (magnitudeSquared(p) > bailout) {
+            escaped = true;
+            break;
+        }
+
+        const Real x2 = x * x;
+        const Real y2 = y * y;
+        y = 2 * x * y + y0;
+        x = x2 - y2 + x0;
+    }
+}
+
+double Perturbation::bailoutFor(float radius) {
+    // the reference has to survive a bit longer than the pixels around it
+    return std::max(1e6, 16.0 * radius * radius);
+}
+
+glm::dvec2 Perturbation::offset(const ReferenceOrbit &primary,
+                                const HighPrecision &cx,
+                                const HighPrecision &cy, int exponent) {
+    return glm::dvec2(toDouble(ldexp(cx - primary.cx, -exponent)),
+                      toDouble(ldexp(cy - primary.cy, -exponent)));
+}
+
+bool Perturbation::coversPrimary(const Orbits &o, const HighPrecision &cx,
+                                 const HighPrecision &cy,
+                                 const FloatExp &zoom, int maxIter,
+                                 float radius) {
+    const ReferenceOrbit *primary = o.primary.get();
+    if (!primary)
+        return false;
+
+    if (ReferenceOrbit::requiredBits(zoom) > primary->bits)
+        return false;
+
+    if (primary->bailout != bailoutFor(radius))
+        return false;
+
+    if (!primary->escaped && primary->maxIter < maxIter)
+        return false;
+
+    // The reference must stay in the viewport, otherwise the deltas get large
+    // and most of the pixels are glitched
+    const HighPrecision z = zoom.toHighPrecision();
+    return abs(cx - primary->cx) <= z && abs(cy - primary->cy) <= z;
+}
+
+bool Perturbation::coversSecondary(const Orbits &o, const FloatExp &zoom,
+                                   int maxIter) {
+    // the glitches move when zooming, so the secondary reference is only
+    // valid for roughly the same viewport
+    return o.probeIter == maxIter && zoom > o.probeZoom / 4 &&
+           zoom < o.probeZoom * 4;
+}
+
+bool Perturbation::coversBLA(const Orbits &o, const HighPrecision &cx,
+                             const HighPrecision &cy, const FloatExp &zoom,
+                             float radius) {
+    // the table only depends on the primary orbit
+    if (!o.bla.get() || o.blaOrbit != o.primary ||
+        o.blaEnabled != (zoom < blaMaxZoom))
+        return false;
+
+    // |dc| of the pixels in the corners. This underflows beyond 1e-308, but
+    // mandelfe.frag doesn't use the table anyway.
+    const glm::dvec2 d = offset(*o.primary, cx, cy);
+    const double dcMax = std::sqrt(d.x * d.x + d.y * d.y) + zoom.toDouble();
+    return o.bla->covers(dcMax, double(radius) * radius);
+}
+
+bool Perturbation::covers(const Orbits &o, const HighPrecision &cx,
+                          const HighPrecision &cy, const FloatExp &zoom,
+                          int maxIter, float radius) {
+    return coversPrimary(o, cx, cy, zoom, maxIter, radius) &&
+           coversSecondary(o, zoom, maxIter) &&
+           coversBLA(o, cx, cy, zoom, radius);
+}
+
+int Perturbation::iterate(const vector<glm::dvec2> &orbit,
+                          glm::dvec2 dcMantissa, int dcExponent, int maxIter,
+                          double radius2, bool &glitched) {
+    glitched = false;
+
+    // dz = w * 2^s, scale = 2^s and dcScaled = dc * 2^-s. Inserting this in
+    // dz' = 2 Z dz + dz^2 + dc gives w' = 2 Z w + scale w^2 + dcScaled.
+    glm::dvec2 w(0.);
+    int s = dcExponent;
+    double scale = std::ldexp(1., s);
+    glm::dvec2 dcScaled = dcMantissa;
+    size_t n = 0;
+
+    for (int j = 0; j <= maxIter; j++) {
+        if (j % rescaleInterval == 0) {
+            const double m = std::max(std::abs(w.x), std::abs(w.y));
+            if (m > 0.) {
+                int k;
+                std::frexp(m, &k);
+                w = glm::dvec2(std::ldexp(w.x, -k), std::ldexp(w.y, -k));
+                s += k;
+                scale = std::ldexp(1., s);
+                dcScaled = glm::dvec2(std::ldexp(dcMantissa.x, dcExponent - s),
+                                      std::ldexp(dcMantissa.y, dcExponent - s));
+            }
+        }
+
+        w = imMul(2. * orbit[n] + scale * w, w) + dcScaled;
+        n++;
+
+        const glm::dvec2 z = orbit[n] + scale * w;
+        const double mag = magnitudeSquared(z);
+        if (mag > radius2) {
+            return j;
+        }
+
+        const bool glitch = mag < glitchTolerance * magnitudeSquared(orbit[n]);
+        glitched |= glitch;
+        if (glitch || n == orbit.size() - 1) {
+            // rebase, z fits into doubles
+            w = z;
+            s = 0;
+            scale = 1.;
+            dcScaled = glm::dvec2(std::ldexp(dcMantissa.x, dcExponent),
+                                  std::ldexp(dcMantissa.y, dcExponent));
+            n = 0;
+        }
+    }
+
+    return maxIter;
+}
+
+void Perturbation::findSecondary(Orbits &o, const HighPrecision &cx,
+                                 const HighPrecision &cy,
+                                 const FloatExp &zoom, int maxIter,
+                                 float radius) {
+    // Probe the viewport on a coarse grid. Among the glitched probes the one
+    // with the most iterations is a good reference, because deep points tend
+    // to be close to a minibrot which has a long, stable orbit.
+    // dc = (center + grid * zoom.m) * 2^zoom.e, so this works beyond 1e-308.
+    const int probes = 16;
+    const ReferenceOrbit &primary = *o.primary;
+    const glm::dvec2 center = offset(primary, cx, cy, zoom.e);
+    const double radius2 = double(radius) * radius;
+
+    int best = -1;
+    glm::dvec2 bestDc(0.);
+
+    for (int i = 0; i < probes; i++) {
+        for (int j = 0; j < probes; j++) {
+            const glm::dvec2 dc =
+                center + glm::dvec2((i + .5) / probes - .5,
+                                    (j + .5) / probes - .5) *
+                             zoom.m;
+
+            bool glitched;
+            const int iter = iterate(primary.points, dc, zoom.e, maxIter,
+                                     radius2, glitched);
+            if (glitched && iter > best) {
+                best = iter;
+                bestDc = dc;
+            }
+        }
+    }
+
+    o.probeZoom = zoom;
+    o.probeIter = maxIter;
+
+    if (best < 0) {
+        o.secondary.reset();
+        o.secondaryOffsetMantissa = glm::dvec2(0.);
+        o.secondaryOffsetExponent = 0;
+        return;
+    }
+
+    const HighPrecision dx = ldexp(HighPrecision(bestDc.x), zoom.e);
+    const HighPrecision dy = ldexp(HighPrecision(bestDc.y), zoom.e);
+    o.secondary = make_shared<ReferenceOrbit>(
+        primary.cx + dx, primary.cy + dy, zoom, maxIter, primary.bailout);
+    toFloatExp(-dx, -dy, o.secondaryOffsetMantissa,
+               o.secondaryOffsetExponent);
+}
+
+vector<uint8_t> Perturbation::serialize(const Orbits &o) {
+    ReferenceOrbitHeader header{};
+    const int32_t e = o.secondaryOffsetExponent;
+    header.secondaryOffset =
+        glm::dvec2(std::ldexp(o.secondaryOffsetMantissa.x, e),
+                   std::ldexp(o.secondaryOffsetMantissa.y, e));
+    header.secondaryOffsetMantissa = glm::vec2(o.secondaryOffsetMantissa);
+    header.secondaryOffsetExponent = o.secondaryOffsetExponent;
+    header.primaryLength = int32_t(o.primary->points.size());
+    header.secondaryLength =
+        o.secondary.get() ? int32_t(o.secondary->points.size()) : 0;
+
+    const size_t orbitSize = sizeof(glm::dvec2) * (size_t(header.primaryLength) +
+                                                   header.secondaryLength);
+    vector<uint8_t> data(sizeof(header) + orbitSize);
+
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), o.primary->points.data(),
+           sizeof(glm::dvec2) * header.primaryLength);
+    if (o.secondary.get()) {
+        memcpy(data.data() + sizeof(header) +
+                   sizeof(glm::dvec2) * header.primaryLength,
+               o.secondary->points.data(),
+               sizeof(glm::dvec2) * header.secondaryLength);
+    }
+    return data;
+}
+
+void Perturbation::buildBLA(Orbits &o, const FloatExp &zoom, double dcMax,
+                            float radius) {
+    // The table is built for twice the current |dc|, so it survives a bit of
+    // panning and zooming out.
+    o.blaEnabled = zoom < blaMaxZoom;
+    o.bla = make_shared<BilinearApproximation>(
+        o.blaEnabled ? o.primary->points : vector<glm::dvec2>(), 2 * dcMax,
+        double(radius) * radius);
+    o.blaOrbit = o.primary;
+}
+
+Perturbation::Update
+Perturbation::compute(shared_ptr<const Orbits> old, HighPrecision cx,
+                      HighPrecision cy, FloatExp zoom, int maxIter,
+                      float radius) {
+    auto o = old.get() ? make_shared<Orbits>(*old) : make_shared<Orbits>();
+    Update u;
+
+    const bool reusePrimary =
+        coversPrimary(*o, cx, cy, zoom, maxIter, radius);
+    if (!reusePrimary || !coversSecondary(*o, zoom, maxIter)) {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (!reusePrimary) {
+            o->primary = make_shared<ReferenceOrbit>(cx, cy, zoom, maxIter,
+                                                     bailoutFor(radius));
+        }
+        findSecondary(*o, cx, cy, zoom, maxIter, radius);
+        u.orbitData = serialize(*o);
+
+        u.orbitTime =
+            std::chrono::duration<float, std::chrono::milliseconds::period>(
+                std::chrono::high_resolution_clock::now() - startTime)
+                .count();
+    }
+
+    if (!coversBLA(*o, cx, cy, zoom, radius)) {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        const glm::dvec2 d = offset(*o->primary, cx, cy);
+        const double dcMax =
+            std::sqrt(d.x * d.x + d.y * d.y) + zoom.toDouble();
+        buildBLA(*o, zoom, dcMax, radius);
+        u.blaData = o->bla->serialize();
+
+        u.blaTime =
+            std::chrono::duration<float, std::chrono::milliseconds::period>(
+                std::chrono::high_resolution_clock::now() - startTime)
+                .count();
+    }
+
+    u.orbits = o;
+    // the main loop might be idle, see Fractal::needsFrame
+    wakeMainLoop();
+    return u;
+}
+
+void Perturbation::use(vk::CommandBuffer commandBuffer, Update &u) {
+    // Pending frames may still read the old buffers, the frame recorded now
+    // reads the new ones once they are copied
+    if (!u.orbitData.empty()) {
+        auto b = make_shared<StorageBuffer>(device, u.orbitData.size());
+        commandPool->retire(b->record(commandBuffer, u.orbitData.data()));
+        commandPool->retire(buffer);
+        buffer = b;
+
+        const Orbits &o = *u.orbits;
+        commitJS("setRenderParams",
+                 "{orbitTime:" + jsStrD(u.orbitTime) +
+                     ",orbitLength:" + jsStr(o.primary->points.size()) +
+                     ",secondaryLength:" +
+                     jsStr(o.secondary.get() ? o.secondary->points.size()
+                                             : size_t(0)) +
+                     ",orbitBits:" + jsStr(size_t(o.primary->bits)) + "}");
+    }
+    if (!u.blaData.empty()) {
+        auto b = make_shared<StorageBuffer>(device, u.blaData.size());
+        commandPool->retire(b->record(commandBuffer, u.blaData.data()));
+        commandPool->retire(blaBuffer);
+        blaBuffer = b;
+
+        commitJS("setRenderParams",
+                 "{blaTime:" + jsStrD(u.blaTime) +
+                     ",blaLevels:" + jsStr(u.orbits->bla->levels()) + "}");
+    }
+
+    orbits = u.orbits;
+    bufferGeneration++;
+}
+
+bool Perturbation::update(vk::CommandBuffer commandBuffer,
+                          const HighPrecision &cx, const HighPrecision &cy,
+                          const FloatExp &zoom, int maxIter, float radius) {
+    bool changed = false;
+    if (job.valid()) {
+        if (job.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+            return false;
+
+        Update u = job.get();
+        use(commandBuffer, u);
+        changed = true;
+    }
+
+    // the view might have moved on while the job was running
+    if (!orbits.get() || !covers(*orbits, cx, cy, zoom, maxIter, radius)) {
+        job = std::async(std::launch::async, &Perturbation::compute, orbits,
+                         cx, cy, zoom, maxIter, radius);
+    }
+
+    return changed;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "buffer.h"
+#include "commandBuffer.h"
+#include "highPrecision.h"
+#include "floatExp.h"
+#include "bla.h"
+
+#include <future>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/*
+Perturbation theory for deep zooms
+
+Near the reference point C, each pixel c = C + dc can be written as
+z_n = Z_n + dz_n, where Z_n is the orbit of the reference. Inserting this in
+z_{n+1} = z_n^2 + c yields
+
+    dz_{n+1} = 2 Z_n dz_n + dz_n^2 + dc
+
+which only contains small numbers. So, only the reference orbit has to be
+computed with arbitrary precision (once, on the CPU) while the GPU iterates
+the deltas with doubles.
+
+When z_n gets close to zero compared to Z_n, the delta can't represent the
+pixel any longer ("glitch", detected using Pauldelbrot's criterion
+|Z_n + dz_n| < 1e-3 |Z_n|). Such pixels are rendered again against a second
+reference which is placed in a glitched region. If that doesn't help either,
+the pixel is rebased onto the beginning of the current orbit (Zhuoran).
+
+For deep zooms, most of the iterations can be skipped using a table of
+bilinear approximations derived from the primary orbit (see bla.h).
+
+Beyond 1e-300 the deltas don't fit into doubles anymore. mandelfe.frag
+iterates them with a float mantissa and a separate exponent instead (see
+floatExp.h). The orbit itself always fits into doubles.
+*/
+
+// Layout (std430) of the storage buffer at binding 2 of the perturbation
+// shaders. The points of the primary orbit follow directly, the secondary
+// orbit starts at index primaryLength.
+struct alignas(16) ReferenceOrbitHeader {
+    // primary reference - secondary reference
+    alignas(16) glm::dvec2 secondaryOffset;
+    alignas(4) int32_t primaryLength;
+    alignas(4) int32_t secondaryLength;
+    // secondaryOffset = secondaryOffsetMantissa * 2^secondaryOffsetExponent
+    // for mandelfe.frag
+    alignas(8) glm::vec2 secondaryOffsetMantissa;
+    alignas(4) int32_t secondaryOffsetExponent;
+};
+static_assert(sizeof(ReferenceOrbitHeader) == 48,
+              "ReferenceOrbitHeader doesn't match the std430 layout");
+
+// Z_0 = 0, Z_{n+1} = Z_n^2 + C computed with as much precision as the zoom
+// requires, rounded to doubles afterwards
+class ReferenceOrbit : private boost::noncopyable {
+  public:
+    ReferenceOrbit(const HighPrecision &cx, const HighPrecision &cy,
+                   const FloatExp &zoom, int maxIter, double bailout);
+
+    // Number of bits necessary to compute the orbit accurately enough for
+    // the given zoom
+    static unsigned requiredBits(const FloatExp &zoom);
+
+    // precision that is actually used to compute an orbit with the given
+    // requirements
+    static unsigned availableBits(unsigned bits);
+
+    const HighPrecision cx;
+    const HighPrecision cy;
+    const unsigned bits;
+    const int maxIter;
+    const double bailout;
+
+    // true if the orbit left the bailout radius before reaching maxIter
+    bool escaped = false;
+    vector<glm::dvec2> points;
+
+  private:
+    template <unsigned Bits> void iterate();
+};
+
+class Perturbation : private boost::noncopyable {
+  public:
+    Perturbation(shared_ptr<LogicalDevice> device,
+                 shared_ptr<CommandPool> commandPool)
+        : device(device), commandPool(commandPool) {}
+
+    // Makes sure the reference orbits and the BLA table cover the viewport
+    // centered at (cx, cy). They are computed on another thread while the
+    // old ones stay in use. Once finished, the copies into new buffers are
+    // recorded into commandBuffer. Returns true if a buffer was replaced,
+    // i.e. they have to be bound again.
+    bool update(vk::CommandBuffer commandBuffer, const HighPrecision &cx,
+                const HighPrecision &cy, const FloatExp &zoom, int maxIter,
+                float radius);
+
+    // False while no orbit was computed with enough precision for the zoom,
+    // i.e. rendering has to wait for update
+    bool usable(const FloatExp &zoom) const {
+        return orbits.get() &&
+               ReferenceOrbit::requiredBits(zoom) <= orbits->primary->bits;
+    }
+
+    // true once new orbits were computed, the next update uses them
+    bool finished() const {
+        return job.valid() && job.wait_for(std::chrono::seconds(0)) ==
+                                  std::future_status::ready;
+    }
+
+    // (viewport center - primary reference) * 2^-exponent
+    glm::dvec2 offset(const HighPrecision &cx, const HighPrecision &cy,
+                      int exponent = 0) const {
+        return offset(*orbits->primary, cx, cy, exponent);
+    }
+
+    // Whether the deltas have to be iterated with a separate exponent, i.e.
+    // using mandelfe.frag instead of mandelp.frag
+    static bool needsFloatExp(const FloatExp &zoom) {
+        return zoom < floatExpMaxZoom;
+    }
+
+    vk::Buffer handle() const { return buffer->handle(); }
+    vk::DeviceSize range() const { return buffer->range(); }
+
+    vk::Buffer blaHandle() const { return blaBuffer->handle(); }
+    vk::DeviceSize blaRange() const { return blaBuffer->range(); }
+
+    // incremented whenever one of the buffers is replaced
+    uint64_t generation() const { return bufferGeneration; }
+
+    // Pauldelbrot's criterion (squared)
+    static constexpr double glitchTolerance = 1e-6;
+
+    // Mirrors the loop in mandelfe.frag (without switching to the secondary
+    // reference and with double mantissas) for dc = dcMantissa * 2^dcExponent.
+    // Returns the number of iterations.
+    static int iterate(const vector<glm::dvec2> &orbit, glm::dvec2 dcMantissa,
+                       int dcExponent, int maxIter, double radius2,
+                       bool &glitched);
+
+    // The exponent of the deltas is adjusted every that many iterations
+    static constexpr int rescaleInterval = 8;
+
+  private:
+    // Everything derived from the reference points. Built by a job and only
+    // read afterwards, so a job can reuse parts of the current one.
+    struct Orbits {
+        shared_ptr<ReferenceOrbit> primary;
+        shared_ptr<ReferenceOrbit> secondary;
+        // secondaryOffset = secondaryOffsetMantissa * 2^secondaryOffsetExponent
+        glm::dvec2 secondaryOffsetMantissa = glm::dvec2(0.);
+        int32_t secondaryOffsetExponent = 0;
+
+        // viewport the secondary reference was searched for
+        FloatExp probeZoom;
+        int probeIter = 0;
+
+        shared_ptr<BilinearApproximation> bla;
+        shared_ptr<ReferenceOrbit> blaOrbit;
+        bool blaEnabled = false;
+    };
+
+    // Result of a job. The data is empty for buffers that stay the same.
+    struct Update {
+        shared_ptr<const Orbits> orbits;
+        vector<uint8_t> orbitData;
+        vector<uint8_t> blaData;
+        // in ms
+        float orbitTime = 0.f;
+        float blaTime = 0.f;
+    };
+
+    static double bailoutFor(float radius);
+
+    static glm::dvec2 offset(const ReferenceOrbit &primary,
+                             const HighPrecision &cx, const HighPrecision &cy,
+                             int exponent = 0);
+
+    // whether o is still good for the viewport, i.e. no job is necessary
+    static bool covers(const Orbits &o, const HighPrecision &cx,
+                       const HighPrecision &cy, const FloatExp &zoom,
+                       int maxIter, float radius);
+    static bool coversPrimary(const Orbits &o, const HighPrecision &cx,
+                              const HighPrecision &cy, const FloatExp &zoom,
+                              int maxIter, float radius);
+    static bool coversSecondary(const Orbits &o, const FloatExp &zoom,
+                                int maxIter);
+    static bool coversBLA(const Orbits &o, const HighPrecision &cx,
+                          const HighPrecision &cy, const FloatExp &zoom,
+                          float radius);
+
+    static void findSecondary(Orbits &o, const HighPrecision &cx,
+                              const HighPrecision &cy, const FloatExp &zoom,
+                              int maxIter, float radius);
+    static void buildBLA(Orbits &o, const FloatExp &zoom, double dcMax,
+                         float radius);
+    // header and points in the layout of ReferenceOrbitHeader
+    static vector<uint8_t> serialize(const Orbits &o);
+
+    // The job: recomputes what old doesn't cover. Runs on another thread.
+    static Update compute(shared_ptr<const Orbits> old, HighPrecision cx,
+                          HighPrecision cy, FloatExp zoom, int maxIter,
+                          float radius);
+
+    // replaces the buffers with the result of the job
+    void use(vk::CommandBuffer commandBuffer, Update &u);
+
+  private:
+    const shared_ptr<LogicalDevice> device;
+    const shared_ptr<CommandPool> commandPool;
+
+    // Above this zoom, |dc| is too large for merged steps to be valid
+    static constexpr double blaMaxZoom = 1e-12;
+    // Below this zoom the pixel spacing gets close to the smallest double
+    static constexpr double floatExpMaxZoom = 1e-290;
+
+    // the ones in the buffers
+    shared_ptr<const Orbits> orbits;
+    // at most one at a time, it is started again if the view moved on
+    std::future<Update> job;
+
+    shared_ptr<StorageBuffer> buffer;
+    shared_ptr<StorageBuffer> blaBuffer;
+
+    uint64_t bufferGeneration = 0;
+};
@@ -33,7 +33,8 @@ class PhysicalDevice : private boost::noncopyable {
   public:
     PhysicalDevice(shared_ptr<NativeWindow> win,
                    vk::raii::PhysicalDevice const &device)
-        : device(device), win(win), properties(device.getProperties()) {}
+        : device(device), win(win), properties(device.getProperties()),
+          features(device.getFeatures()) {}
     int rateDeviceSuitability() const;
     QueueFamilyIndices findQueueFamilies() const;
     SwapChainSupportDetails querySwapChainSupport() const;
@@ -57,6 +58,8 @@ class PhysicalDevice : private boost::noncopyable {
   public:
     vk::raii::PhysicalDevice device;
     const vk::PhysicalDeviceProperties properties;
+    // e.g. shaderFloat64 decides which Mandelbrot shaders can be used
+    const vk::PhysicalDeviceFeatures features;
 
   private:
     shared_ptr<NativeWindow> win;
@@ -105,9 +105,10 @@ void PipelineBase::createPipeline(vk::ImageLayout finalLayout,
     // store and reuse data relevant to pipeline creation across multiple calls
     // to vkCreateGraphicsPipelines and even across program executions if the
     // cache is stored to a file. This makes it possible to significantly speed
-    // up pipeline creation at a later time.
-    graphicsPipeline =
-        device->device.createGraphicsPipeline(VK_NULL_HANDLE, pipelineInfo);
+    // up pipeline creation at a later time. We use the one of the device,
+    // which is stored in fatouDB.
+    graphicsPipeline = device->device.createGraphicsPipeline(
+        device->pipelineCache, pipelineInfo);
 }
 
 void PipelineBase::createRenderPass(vk::ImageLayout finalLayout,
@@ -13,7 +13,8 @@ class PipelineBase : private boost::noncopyable {
                  vk::Format imageFormat, vk::Format depthFormat,
                  StencilMode stencilMode)
         : frag(frag), vert(vert), device(device), stencilMode(stencilMode),
-          hasBlend(true), extent(extent), imageFormat(imageFormat),
+          hasBlend(supportsBlending(&*device->physical, imageFormat)),
+          extent(extent), imageFormat(imageFormat),
           depthFormat(depthFormat) {}
 
     ~PipelineBase() {
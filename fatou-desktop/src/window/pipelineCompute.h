@@ -0,0 +1,113 @@
+#pragma once
+
+#include "shader.h"
+#include "logicalDevice.h"
+#include "ubo.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// Push constants of interlace.comp
+struct ComputeInterlace {
+    // texture coordinate of pixel p is origin + (p + 0.5) * pitch
+    alignas(8) glm::vec2 origin;
+    alignas(8) glm::vec2 pitch;
+    // invocation g computes pixel offset + g * stride
+    alignas(8) glm::ivec2 offset;
+    alignas(8) glm::ivec2 stride;
+    alignas(8) glm::ivec2 count;
+};
+
+// The compute backend writes rg32f storage images from the queue that also
+// renders the rest of the frame
+inline bool supportsComputeBackend(const PhysicalDevice *physical) {
+    const auto family = physical->findQueueFamilies().graphicsFamily;
+    const auto families = physical->device.getQueueFamilyProperties();
+    return physical->features.shaderStorageImageExtendedFormats &&
+           family.has_value() &&
+           bool(families[family.value()].queueFlags &
+                vk::QueueFlagBits::eCompute);
+}
+
+// Runs a fractal shader as compute shader, see interlace.comp. Unlike the
+// graphics pipelines, there is neither a render pass nor a fixed extent, so
+// all layers share one pipeline and only have their own descriptor sets.
+class ComputePipeline : private boost::noncopyable {
+  public:
+    ComputePipeline(shared_ptr<LogicalDevice> device,
+                    const path &fractalShader, const path &entry,
+                    const Specialization &specialization = {})
+        : device(device),
+          dsl(make_shared<ComputeDescriptorSetLayout>(device)),
+          shader(make_shared<Shader>(device, fractalShader, entry,
+                                     specialization)) {
+        createPipelineLayout();
+        createPipeline();
+    }
+
+    vk::DescriptorSetLayout descriptorSetLayout() const {
+        return *dsl->descriptorSetLayout;
+    }
+    vk::PipelineLayout layout() const { return *pipelineLayout; }
+
+    void bind(vk::CommandBuffer commandBuffer) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+    }
+
+    // computes interlace.count pixels of the layer whose descriptor set is
+    // bound
+    void dispatch(vk::CommandBuffer commandBuffer,
+                  const ComputeInterlace &interlace) {
+        commandBuffer.pushConstants<ComputeInterlace>(
+            *pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, interlace);
+
+        const auto groups = [](int n) {
+            return uint32_t((n + groupSize - 1) / groupSize);
+        };
+        commandBuffer.dispatch(groups(interlace.count.x),
+                               groups(interlace.count.y), 1);
+    }
+
+  private:
+    void createPipelineLayout() {
+        vk::PushConstantRange range{};
+        range.stageFlags = vk::ShaderStageFlagBits::eCompute;
+        range.offset = 0;
+        range.size = sizeof(ComputeInterlace);
+
+        const vk::DescriptorSetLayout setLayout = descriptorSetLayout();
+
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType =
+            vk::StructureType::ePipelineLayoutCreateInfo;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+
+        pipelineLayout =
+            device->device.createPipelineLayout(pipelineLayoutInfo);
+    }
+
+    void createPipeline() {
+        vk::ComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = vk::StructureType::eComputePipelineCreateInfo;
+        pipelineInfo.stage = shader->getInfo();
+        pipelineInfo.layout = *pipelineLayout;
+
+        pipeline = device->device.createComputePipeline(device->pipelineCache,
+                                                        pipelineInfo);
+    }
+
+  public:
+    // must match local_size_x and local_size_y in interlace.comp
+    static constexpr int groupSize = 8;
+
+  private:
+    const shared_ptr<LogicalDevice> device;
+    shared_ptr<ComputeDescriptorSetLayout> dsl;
+    shared_ptr<Shader> shader;
+
+    vk::raii::PipelineLayout pipelineLayout = nullptr;
+    vk::raii::Pipeline pipeline = nullptr;
+};
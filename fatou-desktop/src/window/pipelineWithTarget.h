@@ -4,142 +4,338 @@
 #include "logicalDevice.h"
 #include "ubo.h"
 #include "framebuffer.h"
+#include "pipelineCompute.h"
+#include "../shaderc/include/fatou-shaderc.h"
 
 class PipelineWithDescriptorBase {
   public:
     virtual shared_ptr<FractalRenderPassManager>
-    makeRPM(const CommandBufferRecorder &rec, vk::Framebuffer frameBuffer) = 0;
-    virtual void updateVertex(const UniformBufferObject &ubo) = 0;
+    makeRPM(const CommandBufferRecorder &rec, vk::Framebuffer frameBuffer,
+            Extent2D extent) = 0;
+    // frame is the frame in flight that is recorded, see UniformRing
+    virtual void updateVertex(uint32_t frame,
+                              const UniformBufferObject &ubo) = 0;
 
-    virtual void updateFragment(const UniformBufferObject2 &ubo) = 0;
+    virtual void updateFragment(uint32_t frame,
+                                const UniformBufferObject2 &ubo) = 0;
+    virtual void updateStorage(uint32_t binding, vk::Buffer buffer,
+                               vk::DeviceSize range) = 0;
     virtual void bind(vk::CommandBuffer commandBuffer) = 0;
     virtual shared_ptr<PipelineBase> getPipeline() = 0;
+    // Switches to a pipeline with the same layout, e.g. a specialized one. The
+    // descriptor sets stay, their layouts are defined identically.
+    virtual void usePipeline(shared_ptr<PipelineBase> pipeline) = 0;
 };
 
-template <class DSL, class DP>
+// A pipeline, which may be shared, and descriptors of its own
+template <class DP>
 class PipelineWithDescriptor : public PipelineWithDescriptorBase {
   public:
     PipelineWithDescriptor(shared_ptr<LogicalDevice> device,
-                           const path &vertShader, const path &fragShader,
-                           Extent2D extent, vk::CommandPool commandPool,
-                           vk::ImageLayout initialLayout,
-                           StencilMode stencilMode, vk::Format stencilFormat,
-                           vector<vk::DynamicState> dynamicStates)
-        : extent(extent), device(device) {
-
-        pipeline = make_shared<Pipeline<DSL>>(
-            device, make_shared<Shader>(device, vertShader, ShaderType::VERTEX),
-            make_shared<Shader>(device, fragShader, ShaderType::FRAGMENT),
-            extent, vk::Format::eR8G8B8A8Srgb, make_shared<DSL>(device),
-            vk::ImageLayout::eShaderReadOnlyOptimal, initialLayout,
-            stencilFormat, stencilMode, dynamicStates);
-
-        dsl = make_shared<DSL>(device);
-        descriptors = make_shared<DP>(device, *dsl->descriptorSetLayout);
+                           shared_ptr<PipelineBase> pipeline,
+                           size_t framesInFlight)
+        : device(device), pipeline(pipeline) {
+        descriptors = make_shared<DP>(
+            device, pipeline->descriptorSetLayout(), framesInFlight);
     }
 
     shared_ptr<FractalRenderPassManager>
-    makeRPM(const CommandBufferRecorder &rec,
-            vk::Framebuffer frameBuffer) override {
+    makeRPM(const CommandBufferRecorder &rec, vk::Framebuffer frameBuffer,
+            Extent2D extent) override {
         return make_shared<FractalRenderPassManager>(rec, frameBuffer,
-                                                     &*pipeline);
+                                                     &*pipeline, extent);
+    }
+
+    void updateVertex(uint32_t frame,
+                      const UniformBufferObject &ubo) override {
+        descriptors->updateVertex(frame, ubo);
     }
 
-    void updateVertex(const UniformBufferObject &ubo) override {
-        descriptors->updateVertex(ubo);
+    void updateFragment(uint32_t frame,
+                        const UniformBufferObject2 &ubo) override {
+        descriptors->updateFragment(frame, ubo);
     }
 
-    void updateFragment(const UniformBufferObject2 &ubo) override {
-        descriptors->updateFragment(ubo);
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range) override {
+        descriptors->updateStorage(binding, buffer, range);
     }
 
     void bind(vk::CommandBuffer commandBuffer) override {
         descriptors->bind(commandBuffer, pipeline->layout());
     }
 
-    const Extent2D extent;
-
     shared_ptr<PipelineBase> getPipeline() override { return pipeline; }
 
+    void usePipeline(shared_ptr<PipelineBase> pipeline) override {
+        this->pipeline = pipeline;
+    }
+
   protected:
     shared_ptr<LogicalDevice> device;
-    shared_ptr<Pipeline<DSL>> pipeline;
+    shared_ptr<PipelineBase> pipeline;
     shared_ptr<DP> descriptors;
-    shared_ptr<DSL> dsl;
 };
 
 enum class MultiPipeMode { eSimple, eStencilWrite, eStencilRead, eEnd };
 
-template <class DSL> class MultiPipe {
-  public:
-    MultiPipe(shared_ptr<LogicalDevice> device, const path &p, Extent2D extent,
-              vk::CommandPool commandPool, vk::ImageUsageFlags moreFlags = {},
-              vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined,
-              bool withStencil = false)
-        : extent(extent), device(device) {
+// How the layers of an InterlacedRenderer are computed
+enum class RenderBackend {
+    // fragment shaders, which skip the known pixels with a stencil buffer
+    eGraphics,
+    // compute shaders, which only run for the new pixels (interlace.comp)
+    eCompute
+};
+
+// The fractal shaders write the iteration count and the smoothing term, which
+// are coloured by the compositor (colorize.frag)
+static constexpr vk::Format fractalImageFormat = vk::Format::eR32G32Sfloat;
+
+// The parameters that are compiled into the fractal shaders while play is 0,
+// see the specialization constants in mandel.frag. They rarely change, so a
+// specialized pipeline is used for many frames.
+struct FractalSpecialization {
+    int32_t maxIter;
+    float radius;
+
+    bool operator<(const FractalSpecialization &o) const {
+        return std::tie(maxIter, radius) < std::tie(o.maxIter, o.radius);
+    }
+    bool operator==(const FractalSpecialization &o) const {
+        return maxIter == o.maxIter && radius == o.radius;
+    }
 
-        static vk::Format stencilFormat =
-            getSupportedStencilFormat(&*device->physical);
+    Specialization constants() const {
+        return Specialization()
+            .set(0, true)
+            .set(1, maxIter)
+            .set(2, radius);
+    }
+};
+
+// The pipelines of all modes, shared by the layers of an InterlacedRenderer.
+// Their render passes are compatible, so they work with the framebuffer of
+// every layer. The layers only differ in extent, which is dynamic state.
+template <class DSL> class MultiPipeline : private boost::noncopyable {
+  public:
+    // specialization is only used for the fractal shader p
+    MultiPipeline(shared_ptr<LogicalDevice> device, const path &p,
+                  Extent2D extent,
+                  vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined,
+                  const Specialization &specialization = {})
+        : stencilFormat(getSupportedStencilFormat(&*device->physical)) {
 
         pipelines.resize(3);
 
-        vector<vk::DynamicState> dynamicStates = {vk::DynamicState::eScissor};
+        const vector<vk::DynamicState> dynamicStates = {
+            vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+
+        precompileShaders(
+            {{shaderPath / "playground" / "simple.vert", true},
+             {p, false},
+             {shaderPath / "playground" / "instanced.vert", true},
+             {shaderPath / "playground" / "white.frag", false}});
 
-        pipelines[size_t(MultiPipeMode::eSimple)] =
-            make_shared<PipelineWithDescriptor<
-                DSL, DefaultDescriptorPool<UniformBufferObject,
-                                           UniformBufferObject2>>>(
-                device, shaderPath / "playground" / "simple.vert", p, extent,
-                commandPool, initialLayout, StencilMode::eIgnore, stencilFormat,
-                dynamicStates);
+        const auto simpleVert = make_shared<Shader>(
+            device, shaderPath / "playground" / "simple.vert",
+            ShaderType::VERTEX);
+        const auto fractal = make_shared<Shader>(
+            device, p, ShaderType::FRAGMENT, specialization);
+
+        pipelines[size_t(MultiPipeMode::eSimple)] = make_shared<Pipeline<DSL>>(
+            device, simpleVert, fractal, extent, fractalImageFormat,
+            make_shared<DSL>(device), vk::ImageLayout::eShaderReadOnlyOptimal,
+            initialLayout, stencilFormat, StencilMode::eIgnore, dynamicStates);
 
         pipelines[size_t(MultiPipeMode::eStencilRead)] =
-            make_shared<PipelineWithDescriptor<
-                DSL, DefaultDescriptorPool<UniformBufferObject,
-                                           UniformBufferObject2>>>(
-                device, shaderPath / "playground" / "simple.vert", p, extent,
-                commandPool, initialLayout, StencilMode::eRead, stencilFormat,
-                dynamicStates);
+            make_shared<Pipeline<DSL>>(
+                device, simpleVert, fractal, extent, fractalImageFormat,
+                make_shared<DSL>(device),
+                vk::ImageLayout::eShaderReadOnlyOptimal, initialLayout,
+                stencilFormat, StencilMode::eRead, dynamicStates);
 
         pipelines[size_t(MultiPipeMode::eStencilWrite)] =
-            make_shared<PipelineWithDescriptor<
-                DescriptorSetLayoutVertexOnly,
-                DefaultDescriptorPoolVertex<UniformBufferObject,
-                                            UniformBufferObject2>>>(
-                device, shaderPath / "playground" / "instanced.vert",
-                shaderPath / "playground" / "white.frag", extent, commandPool,
-                initialLayout, StencilMode::eWrite, stencilFormat,
-                vector<vk::DynamicState>());
+            make_shared<Pipeline<DescriptorSetLayoutVertexOnly>>(
+                device,
+                make_shared<Shader>(device,
+                                    shaderPath / "playground" /
+                                        "instanced.vert",
+                                    ShaderType::VERTEX),
+                make_shared<Shader>(device,
+                                    shaderPath / "playground" / "white.frag",
+                                    ShaderType::FRAGMENT),
+                extent, fractalImageFormat,
+                make_shared<DescriptorSetLayoutVertexOnly>(device),
+                vk::ImageLayout::eShaderReadOnlyOptimal, initialLayout,
+                stencilFormat, StencilMode::eWrite, dynamicStates);
+    }
+
+    shared_ptr<PipelineBase> get(MultiPipeMode mode) const {
+        return pipelines[size_t(mode)];
+    }
+
+    const vk::Format stencilFormat;
+
+  private:
+    vector<shared_ptr<PipelineBase>> pipelines;
+};
+
+template <class DSL> class MultiPipe {
+  public:
+    static constexpr vk::Format imageFormat = fractalImageFormat;
+
+    // Layer of the graphics backend: a framebuffer with a stencil buffer and
+    // descriptor sets for the shared pipelines
+    MultiPipe(shared_ptr<LogicalDevice> device,
+              shared_ptr<MultiPipeline<DSL>> shared, Extent2D extent,
+              vk::CommandPool commandPool, size_t framesInFlight,
+              vk::ImageUsageFlags moreFlags = {})
+        : extent(extent), device(device), shared(shared) {
+
+        pipelines.resize(3);
+
+        pipelines[size_t(MultiPipeMode::eSimple)] = make_shared<
+            PipelineWithDescriptor<DefaultDescriptorPool<
+                UniformBufferObject, UniformBufferObject2>>>(
+            device, shared->get(MultiPipeMode::eSimple), framesInFlight);
+
+        pipelines[size_t(MultiPipeMode::eStencilRead)] = make_shared<
+            PipelineWithDescriptor<DefaultDescriptorPool<
+                UniformBufferObject, UniformBufferObject2>>>(
+            device, shared->get(MultiPipeMode::eStencilRead), framesInFlight);
+
+        pipelines[size_t(MultiPipeMode::eStencilWrite)] = make_shared<
+            PipelineWithDescriptor<DefaultDescriptorPoolVertex<
+                UniformBufferObject, UniformBufferObject2>>>(
+            device, shared->get(MultiPipeMode::eStencilWrite),
+            framesInFlight);
 
         frameBuffer = make_shared<FractalFramebuffer>(
-            device, commandPool,
-            pipelines[size_t(MultiPipeMode::eStencilRead)]->getPipeline(),
-            moreFlags, stencilFormat);
+            device, commandPool, shared->get(MultiPipeMode::eStencilRead),
+            extent, moreFlags, shared->stencilFormat);
+    }
+
+    // Layer of the compute backend: just a storage image and the descriptor
+    // set of the shared pipeline, no render passes or stencil buffers
+    MultiPipe(shared_ptr<LogicalDevice> device,
+              shared_ptr<ComputePipeline> compute, Extent2D extent,
+              vk::CommandPool commandPool, size_t framesInFlight,
+              vk::ImageUsageFlags moreFlags = {})
+        : extent(extent), device(device), compute(compute) {
+        storage = make_shared<OnlineTexture>(
+            device, commandPool, extent.width, extent.height,
+            vk::ImageUsageFlagBits::eStorage | moreFlags, imageFormat);
+        storage->transitionToRead();
+        computeDescriptors = make_shared<ComputeDescriptorPool>(
+            device, compute->descriptorSetLayout(), storage->imageView(),
+            framesInFlight);
     }
 
     shared_ptr<FractalRenderPassManager>
     makeRPM(const CommandBufferRecorder &rec, MultiPipeMode mode) {
-        return pipelines[size_t(mode)]->makeRPM(rec,
-                                                frameBuffer->getFramebuffer());
+        return pipelines[size_t(mode)]->makeRPM(
+            rec, frameBuffer->getFramebuffer(), extent);
+    }
+
+    void updateVertex(uint32_t frame, const UniformBufferObject &ubo,
+                      MultiPipeMode mode) {
+        pipelines[size_t(mode)]->updateVertex(frame, ubo);
+    }
+
+    void updateFragment(uint32_t frame, const UniformBufferObject2 &ubo,
+                        MultiPipeMode mode) {
+        if (compute) {
+            computeDescriptors->updateFragment(frame, ubo);
+            return;
+        }
+        pipelines[size_t(mode)]->updateFragment(frame, ubo);
     }
 
-    void updateVertex(const UniformBufferObject &ubo, MultiPipeMode mode) {
-        pipelines[size_t(mode)]->updateVertex(ubo);
+    // Switches all modes to other pipelines of the same shaders, e.g.
+    // specialized ones. Only while no frame using the old ones is recorded.
+    void usePipelines(shared_ptr<MultiPipeline<DSL>> pipelines) {
+        assert(!compute);
+        shared = pipelines;
+        for (size_t mode = 0; mode < size_t(MultiPipeMode::eEnd); mode++)
+            this->pipelines[mode]->usePipeline(
+                pipelines->get(MultiPipeMode(mode)));
+    }
+    void usePipeline(shared_ptr<ComputePipeline> pipeline) {
+        assert(compute);
+        compute = pipeline;
     }
 
-    void updateFragment(const UniformBufferObject2 &ubo, MultiPipeMode mode) {
-        pipelines[size_t(mode)]->updateFragment(ubo);
+    // storage buffers are shared by all modes that run the fractal shader
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range) {
+        if (compute) {
+            computeDescriptors->updateStorage(binding, buffer, range);
+            return;
+        }
+        pipelines[size_t(MultiPipeMode::eSimple)]->updateStorage(
+            binding, buffer, range);
+        pipelines[size_t(MultiPipeMode::eStencilRead)]->updateStorage(
+            binding, buffer, range);
     }
 
     void bind(vk::CommandBuffer commandBuffer, MultiPipeMode mode) {
         pipelines[size_t(mode)]->bind(commandBuffer);
     }
 
-    void beforeRead() { frameBuffer->beforeRead(); }
-    void transition(vk::ImageLayout l) { frameBuffer->transition(l); }
-    vk::ImageView imageView() { return frameBuffer->imageView(); }
-    vk::Image image() { return frameBuffer->image(); }
-    vk::ImageLayout imageLayout() { return frameBuffer->imageLayout(); }
+    // Computes the pixels given by interlace. The image is in the general
+    // layout only while the shader writes to it, the barriers are recorded
+    // with the dispatch.
+    void dispatch(vk::CommandBuffer commandBuffer,
+                  const ComputeInterlace &interlace) {
+        assert(compute && storage->imageLayout() ==
+                              vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        // Earlier commands sampled the image or blitted it. The shader only
+        // writes pixels nobody has read yet, but the layout change would
+        // discard the others without the barrier.
+        storage->transitionTo(commandBuffer, vk::ImageLayout::eGeneral);
+
+        compute->bind(commandBuffer);
+        computeDescriptors->bind(commandBuffer, compute->layout());
+        compute->dispatch(commandBuffer, interlace);
+
+        // presented or blitted into the next layer afterwards
+        storage->transitionTo(commandBuffer,
+                              vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
+    void beforeRead() {
+        if (compute) {
+            assert(storage->imageLayout() ==
+                   vk::ImageLayout::eShaderReadOnlyOptimal);
+            return;
+        }
+        frameBuffer->beforeRead();
+    }
+    void transition(vk::ImageLayout l) {
+        if (compute) {
+            storage->transitionTo(l);
+            return;
+        }
+        frameBuffer->transition(l);
+    }
+    // records the transition into the frame, see OnlineTexture::transitionTo
+    void transition(vk::CommandBuffer commandBuffer, vk::ImageLayout l) {
+        if (compute) {
+            storage->transitionTo(commandBuffer, l);
+            return;
+        }
+        frameBuffer->transition(commandBuffer, l);
+    }
+    vk::ImageView imageView() {
+        return compute ? storage->imageView() : frameBuffer->imageView();
+    }
+    vk::Image image() {
+        return compute ? storage->image() : frameBuffer->image();
+    }
+    vk::ImageLayout imageLayout() {
+        return compute ? storage->imageLayout() : frameBuffer->imageLayout();
+    }
 
     const Extent2D extent;
 
@@ -147,4 +343,10 @@ template <class DSL> class MultiPipe {
     shared_ptr<LogicalDevice> device;
     shared_ptr<FractalFramebuffer> frameBuffer;
     vector<shared_ptr<PipelineWithDescriptorBase>> pipelines;
+    shared_ptr<MultiPipeline<DSL>> shared;
+
+    // only for the compute backend
+    shared_ptr<ComputePipeline> compute;
+    shared_ptr<OnlineTexture> storage;
+    shared_ptr<ComputeDescriptorPool> computeDescriptors;
 };
\ No newline at end of file
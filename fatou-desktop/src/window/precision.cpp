@@ -0,0 +1,119 @@
+#include "precision.h"
+#include "perturbation.h"
+
+#include <cmath>
+
+const char *PrecisionSelector::shader(Precision p) {
+    switch (p) {
+    case Precision::eFloat:
+    case Precision::eFloatPair:
+    case Precision::eDouble:
+    case Precision::eDoubleDouble:
+        return "mandel.frag";
+    case Precision::ePerturbation:
+        return "mandelp.frag";
+    default:
+        return "mandelfe.frag";
+    }
+}
+
+const char *PrecisionSelector::variant(Precision p) {
+    switch (p) {
+    case Precision::eFloatPair:
+        return "PRECISION_FLOAT_PAIR";
+    case Precision::eDouble:
+        return "PRECISION_DOUBLE";
+    case Precision::eDoubleDouble:
+        return "PRECISION_DOUBLE_DOUBLE";
+    default:
+        return "";
+    }
+}
+
+const char *PrecisionSelector::name(Precision p) {
+    switch (p) {
+    case Precision::eFloat:
+        return "float";
+    case Precision::eFloatPair:
+        return "float pair";
+    case Precision::eDouble:
+        return "double";
+    case Precision::eDoubleDouble:
+        return "double-double";
+    case Precision::ePerturbation:
+        return "perturbation";
+    default:
+        return "perturbation (floatexp)";
+    }
+}
+
+int PrecisionSelector::mantissaBits(Precision p) {
+    switch (p) {
+    case Precision::eFloat:
+        return 24;
+    case Precision::eFloatPair:
+        return 48;
+    case Precision::eDouble:
+        return 53;
+    case Precision::eDoubleDouble:
+        return 106;
+    default:
+        return 0;
+    }
+}
+
+double PrecisionSelector::requiredBits(const FloatExp &zoom, Extent2D extent) {
+    const double pixels = std::max(1u, std::max(extent.width, extent.height));
+    return 1. - zoom.log2() + std::log2(pixels) + guardBits;
+}
+
+bool PrecisionSelector::available(Precision p, int maxIter) const {
+    switch (p) {
+    case Precision::eFloat:
+    case Precision::eFloatPair:
+        return true;
+    case Precision::eDoubleDouble:
+        return float64 && maxIter <= doubleDoubleMaxIter;
+    default:
+        return float64;
+    }
+}
+
+Precision PrecisionSelector::cheapest(const FloatExp &zoom, int extraBits,
+                                      Extent2D extent, int maxIter) const {
+    const FloatExp z(zoom.m, zoom.e - extraBits);
+    const double bits = requiredBits(z, extent);
+
+    // Float pairs come before doubles, because most consumer GPUs run fp64 at
+    // 1/32 of the fp32 rate
+    for (const Precision p : {Precision::eFloat, Precision::eFloatPair,
+                              Precision::eDouble, Precision::eDoubleDouble}) {
+        if (available(p, maxIter) && bits <= mantissaBits(p))
+            return p;
+    }
+
+    // without doubles, this is the best we can do
+    if (!float64)
+        return Precision::eFloatPair;
+
+    return Perturbation::needsFloatExp(z) ? Precision::ePerturbationFloatExp
+                                          : Precision::ePerturbation;
+}
+
+Precision PrecisionSelector::select(const FloatExp &zoom, Extent2D extent,
+                                    int maxIter) {
+    Precision p = cheapest(zoom, 0, extent, maxIter);
+
+    // stay deeper until the view is clearly past the border
+    if (p < selected && available(selected, maxIter) &&
+        cheapest(zoom, hysteresisBits, extent, maxIter) >= selected) {
+        p = selected;
+    }
+    selected = p;
+
+    const Precision deeper = cheapest(zoom, prewarmBits, extent, maxIter);
+    const Precision shallower = cheapest(zoom, -prewarmBits, extent, maxIter);
+    next = deeper != selected ? deeper : shallower;
+
+    return selected;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "floatExp.h"
+#include "highPrecision.h"
+
+// Arithmetic of the Mandelbrot shaders, from the cheapest to the deepest
+enum class Precision {
+    eFloat,        // mandel.frag
+    eFloatPair,    // mandel.frag (PRECISION_FLOAT_PAIR), emulated doubles
+    eDouble,       // mandel.frag (PRECISION_DOUBLE)
+    eDoubleDouble, // mandel.frag (PRECISION_DOUBLE_DOUBLE)
+    ePerturbation, // mandelp.frag
+    ePerturbationFloatExp // mandelfe.frag
+};
+
+// Picks the cheapest shader that still resolves the pixel spacing of the
+// view. Switching is delayed a bit when zooming out again, so a view at the
+// border doesn't flip back and forth.
+class PrecisionSelector {
+  public:
+    PrecisionSelector(bool float64) : float64(float64) {}
+
+    // returns the precision to render the view with
+    Precision select(const FloatExp &zoom, Extent2D extent, int maxIter);
+
+    // Precision the view will probably need soon, i.e. the renderer that
+    // should be created in advance. Equals the current one if the view is
+    // not close to a border.
+    Precision upcoming() const { return next; }
+
+    Precision current() const { return selected; }
+
+    // the shader and its variant, see shaderVariant
+    static const char *shader(Precision p);
+    static const char *variant(Precision p);
+    static const char *name(Precision p);
+
+    // bits of mantissa the arithmetic has, 0 for unlimited
+    static int mantissaBits(Precision p);
+
+    // Bits the view needs: the pixel spacing relative to |z| <= 2 plus a few
+    // bits for the rounding errors accumulated during the iteration
+    static double requiredBits(const FloatExp &zoom, Extent2D extent);
+
+  private:
+    bool available(Precision p, int maxIter) const;
+    // ignoring the hysteresis, zoom is multiplied with 2^-extraBits
+    Precision cheapest(const FloatExp &zoom, int extraBits, Extent2D extent,
+                       int maxIter) const;
+
+  private:
+    const bool float64;
+    Precision selected = Precision::eFloat;
+    Precision next = Precision::eFloat;
+
+    static constexpr int guardBits = 4;
+    // zooming out has to pass the border by that many bits
+    static constexpr int hysteresisBits = 2;
+    // renderers are prepared when the view is that close to a border
+    static constexpr int prewarmBits = 4;
+    // for long orbits, perturbation with BLA is faster than double-doubles
+    static constexpr int doubleDoubleMaxIter = 4096;
+};
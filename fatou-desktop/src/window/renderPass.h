@@ -65,9 +65,11 @@ class RenderPassManager : private boost::noncopyable {
 
 class FractalRenderPassManager : private boost::noncopyable {
   public:
+    // The pipeline must have a dynamic viewport and scissor, which are set
+    // to the extent of the framebuffer
     FractalRenderPassManager(const CommandBufferRecorder &rec,
                              vk::Framebuffer framebuffer,
-                             PipelineBase *pipeline)
+                             PipelineBase *pipeline, Extent2D extent)
         : commandBuffer(rec.commandBuffer) {
 
         vk::RenderPassBeginInfo renderPassInfo{};
@@ -85,7 +87,7 @@ class FractalRenderPassManager : private boost::noncopyable {
         // The pixels outside this region will have undefined values. It should
         // match the size of the attachments for best performance.
         renderPassInfo.renderArea.offset = vk::Offset2D(0, 0);
-        renderPassInfo.renderArea.extent = pipeline->extent;
+        renderPassInfo.renderArea.extent = extent;
 
         // The last two parameters define the clear values to use for
         // VK_ATTACHMENT_LOAD_OP_CLEAR, which we used as load operation for the
@@ -115,6 +117,11 @@ class FractalRenderPassManager : private boost::noncopyable {
         // Bind pipeline
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
                                    pipeline->getGraphicsPipeline());
+
+        const vk::Viewport viewport(0.f, 0.f, float(extent.width),
+                                    float(extent.height), 0.f, 1.f);
+        commandBuffer.setViewport(0, viewport);
+        commandBuffer.setScissor(0, renderPassInfo.renderArea);
     }
 
     ~FractalRenderPassManager() {
@@ -4,19 +4,34 @@
 
 #include "../shaderc/include/fatou-shaderc.h"
 
-vector<char> vectorFromPointer(const uint8_t *mem, size_t len) {
-    return vector<char>(mem, mem + len);
+Shader::Shader(shared_ptr<LogicalDevice> device, const path &path,
+               const ShaderType::ShaderType type,
+               const Specialization &specialization)
+    : device(device), type(type), shaderModule(nullptr),
+      specialization(specialization),
+      specializationInfo(uint32_t(this->specialization.entries.size()),
+                         this->specialization.entries.data(),
+                         this->specialization.data.size(),
+                         this->specialization.data.data()) {
+    const vector<uint32_t> code =
+        compileShaderFromFile(path, type == ShaderType::VERTEX);
+    if (code.empty())
+        throw runtime_error("shader compilation failed");
+    createShaderModule(code);
 }
 
-Shader::Shader(shared_ptr<LogicalDevice> device, const path &path,
-               const ShaderType::ShaderType type)
-    : device(device), type(type), shaderModule(nullptr) {
-    size_t len;
-    const void *mem =
-        compileShaderFromFile(path, type == ShaderType::VERTEX, len);
-    if (!mem)
+Shader::Shader(shared_ptr<LogicalDevice> device, const path &source,
+               const path &entry, const Specialization &specialization)
+    : device(device), type(ShaderType::COMPUTE), shaderModule(nullptr),
+      specialization(specialization),
+      specializationInfo(uint32_t(this->specialization.entries.size()),
+                         this->specialization.entries.data(),
+                         this->specialization.data.size(),
+                         this->specialization.data.data()) {
+    const vector<uint32_t> code = compileComputeShaderFromFile(source, entry);
+    if (code.empty())
         throw runtime_error("shader compilation failed");
-    createShaderModule(vectorFromPointer((const uint8_t *)mem, len));
+    createShaderModule(code);
 }
 
 vk::PipelineShaderStageCreateInfo Shader::getInfo() const {
@@ -31,7 +46,8 @@ vk::PipelineShaderStageCreateInfo Shader::getInfo() const {
     // render time, because the compiler can do optimizations like
     // eliminating if statements that depend on these values. If you don't
     // have any constants like that, then you can set the member to nullptr
-    shaderStageInfo.pSpecializationInfo = nullptr;
+    shaderStageInfo.pSpecializationInfo =
+        specialization.empty() ? nullptr : &specializationInfo;
 
     switch (type) {
     case ShaderType::VERTEX: {
@@ -40,6 +56,9 @@ vk::PipelineShaderStageCreateInfo Shader::getInfo() const {
     case ShaderType::FRAGMENT: {
         shaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
     } break;
+    case ShaderType::COMPUTE: {
+        shaderStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
+    } break;
     default:
         throw std::runtime_error("unknown shader type");
     }
@@ -51,17 +70,12 @@ Shader::~Shader() {
     //vkDestroyShaderModule(device->handle(), shaderModule, nullptr);
 }
 
-void Shader::createShaderModule(const vector<char> &code) {
+void Shader::createShaderModule(const vector<uint32_t> &code) {
     vk::ShaderModuleCreateInfo createInfo{};
     createInfo.sType = vk::StructureType::eShaderModuleCreateInfo;
-    createInfo.codeSize = code.size();
-
-    // When you perform a cast like this, you also need to ensure that the
-    // data satisfies the alignment requirements of uint32_t. Lucky for us,
-    // the data is stored in an vector where the default allocator already
-    // ensures that the data satisfies the worst case alignment
-    // requirements.
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    // in bytes, but the code must be made of whole (aligned) words
+    createInfo.codeSize = code.size() * sizeof(uint32_t);
+    createInfo.pCode = code.data();
 
     shaderModule = device->device.createShaderModule(createInfo);
 
@@ -5,19 +5,55 @@
 #include "logicalDevice.h"
 
 namespace ShaderType {
-enum ShaderType { VERTEX, FRAGMENT };
+enum ShaderType { VERTEX, FRAGMENT, COMPUTE };
 }
 
+// Values of the specialization constants (layout(constant_id = ...)) of a
+// shader. They are fixed when the pipeline is created, so the driver can fold
+// them like literals.
+class Specialization {
+  public:
+    // T must be bool, int32_t, uint32_t or float like the constant
+    template <class T> Specialization &set(uint32_t id, const T &value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            // booleans are 32 bit in SPIR-V
+            return set<VkBool32>(id, value ? VK_TRUE : VK_FALSE);
+        } else {
+            static_assert(sizeof(T) == 4, "constants are 32 bit");
+            entries.push_back(
+                vk::SpecializationMapEntry(id, uint32_t(data.size()), 4));
+            const auto bytes = reinterpret_cast<const char *>(&value);
+            data.insert(data.end(), bytes, bytes + 4);
+            return *this;
+        }
+    }
+
+    bool empty() const { return entries.empty(); }
+
+  private:
+    friend class Shader;
+    vector<vk::SpecializationMapEntry> entries;
+    vector<char> data;
+};
+
 class Shader : private boost::noncopyable {
   public:
     Shader(shared_ptr<LogicalDevice> device, const path &path,
-           const ShaderType::ShaderType type);
+           const ShaderType::ShaderType type,
+           const Specialization &specialization = {});
+    // compute shader made of the functions in source and the entry point in
+    // entry, see compileComputeShaderFromFile
+    Shader(shared_ptr<LogicalDevice> device, const path &source,
+           const path &entry, const Specialization &specialization = {});
     ~Shader();
     vk::PipelineShaderStageCreateInfo getInfo() const;
 
   private:
-    void createShaderModule(const vector<char> &code);
+    void createShaderModule(const vector<uint32_t> &code);
     vk::raii::ShaderModule shaderModule;
     shared_ptr<LogicalDevice> device;
     const ShaderType::ShaderType type;
+    // points into specialization
+    const Specialization specialization;
+    vk::SpecializationInfo specializationInfo;
 };
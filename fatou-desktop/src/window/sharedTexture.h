@@ -7,8 +7,11 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+class GuiTexture;
+
+// Only guards replacing targetTexture on resizes, not the frames
 extern std::mutex targetMutex;
-extern shared_ptr<OnlineTexture> targetTexture;
+extern shared_ptr<GuiTexture> targetTexture;
 
 enum InputEventDataType {
     MY_KEY_EVENT,
@@ -59,4 +62,11 @@ extern double targetZoomLevel;
 extern std::atomic<GLFWwindow *> glfwWindow;
 
 
-extern SafeQueue<string> presetLoader;
\ No newline at end of file
+extern SafeQueue<string> presetLoader;
+
+// Wakes App::mainLoop while it waits for events because nothing changed,
+// e.g. after CEF painted or sent a preset
+inline void wakeMainLoop() {
+    if (mainLoopRunning)
+        glfwPostEmptyEvent();
+}
\ No newline at end of file
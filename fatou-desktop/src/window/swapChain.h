@@ -5,6 +5,7 @@
 #include "shader.h"
 #include "vulkanUtil.h"
 #include "texture.h"
+#include "../shaderc/include/fatou-shaderc.h"
 
 const path shaderPath = "shaders";
 
@@ -22,6 +23,11 @@ class SwapChain : private boost::noncopyable {
 
         createImageViews();
 
+        precompileShaders(
+            {{shaderPath / "playground" / "simple.vert", true},
+             {shaderPath / "playground" / "pass.frag", false},
+             {shaderPath / "playground" / "colorize.frag", false}});
+
         // TODO: Separate pipeline!
         pipeline = make_shared<Pipeline<DescriptorSetLayout>>(
             device,
@@ -34,6 +40,20 @@ class SwapChain : private boost::noncopyable {
             make_shared<DescriptorSetLayout>(device),
             vk::ImageLayout::ePresentSrcKHR);
 
+        // colours the fractal layers. Its render pass is compatible with the
+        // one of the pipeline above, so both can be used in the same pass.
+        colorPipeline = make_shared<Pipeline<ColorizeDescriptorSetLayout>>(
+            device,
+            make_shared<Shader>(device,
+                                shaderPath / "playground" / "simple.vert",
+                                ShaderType::VERTEX),
+            make_shared<Shader>(device,
+                                shaderPath / "playground" / "colorize.frag",
+                                ShaderType::FRAGMENT),
+            swapChainExtent, imageFormat,
+            make_shared<ColorizeDescriptorSetLayout>(device),
+            vk::ImageLayout::ePresentSrcKHR);
+
         createFramebuffers();
     }
 
@@ -46,6 +66,7 @@ class SwapChain : private boost::noncopyable {
          }*/
 
         pipeline.reset();
+        colorPipeline.reset();
 
         imageViews.clear();
         /* for (size_t i = 0; i < imageViews.size(); i++) {
@@ -89,4 +110,5 @@ class SwapChain : private boost::noncopyable {
 
   public: // TODO: shouldn't be
     shared_ptr<Pipeline<DescriptorSetLayout>> pipeline;
+    shared_ptr<Pipeline<ColorizeDescriptorSetLayout>> colorPipeline;
 };
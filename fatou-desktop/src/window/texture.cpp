@@ -23,7 +23,7 @@ shared_ptr<Texture> Texture::fromFile(shared_ptr<LogicalDevice> device,
 void createImage(const LogicalDevice *device, int w, int h, vk::Format format,
                  vk::ImageTiling tiling, vk::ImageUsageFlags usage,
                  vk::MemoryPropertyFlags properties, vk::raii::Image &image,
-                 vk::raii::DeviceMemory &imageMemory) {
+                 Allocation &imageMemory) {
     vk::ImageCreateInfo imageInfo{};
     imageInfo.sType = vk::StructureType::eImageCreateInfo;
 
@@ -75,20 +75,8 @@ void createImage(const LogicalDevice *device, int w, int h, vk::Format format,
 
     image = device->device.createImage(imageInfo);
 
-    vk::MemoryRequirements memRequirements = image.getMemoryRequirements();
-
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.sType = vk::StructureType::eMemoryAllocateInfo;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex =
-        findMemoryType(device, memRequirements.memoryTypeBits, properties);
-
-    imageMemory = device->device.allocateMemory(allocInfo);
-
-    // TODO: Why not device?
-    // vk::BindImageMemoryInfo(*image, *imageMemory, 0);
-    image.bindMemory(*imageMemory, 0);
-    // vkBindImageMemory(device->handle(), image, imageMemory, 0);
+    // sub-allocated and bound, see MemoryAllocator
+    imageMemory = device->allocator->allocate(*image, properties);
 }
 
 void copyBufferToImage(vk::Device device, vk::CommandPool commandPool,
@@ -366,6 +354,71 @@ void transitionImageLayout(vk::Device device, vk::CommandPool commandPool,
     );
 }
 
+// The accesses an image in the given layout can be subject to, and the stages
+// in which they happen. The fractal layers are read by fragment and compute
+// shaders and blits, and written by render passes, compute shaders and blits.
+static void layoutAccess(vk::ImageLayout layout, vk::AccessFlags &access,
+                         vk::PipelineStageFlags &stages) {
+    switch (layout) {
+    case vk::ImageLayout::eUndefined:
+        access = {};
+        stages = vk::PipelineStageFlagBits::eTopOfPipe;
+        break;
+    case vk::ImageLayout::eShaderReadOnlyOptimal:
+        // render passes of the layers start and end in this layout
+        access = vk::AccessFlagBits::eShaderRead |
+                 vk::AccessFlagBits::eColorAttachmentRead |
+                 vk::AccessFlagBits::eColorAttachmentWrite;
+        stages = vk::PipelineStageFlagBits::eFragmentShader |
+                 vk::PipelineStageFlagBits::eComputeShader |
+                 vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        break;
+    case vk::ImageLayout::eGeneral:
+        access = vk::AccessFlagBits::eShaderRead |
+                 vk::AccessFlagBits::eShaderWrite;
+        stages = vk::PipelineStageFlagBits::eComputeShader;
+        break;
+    case vk::ImageLayout::eTransferSrcOptimal:
+        access = vk::AccessFlagBits::eTransferRead;
+        stages = vk::PipelineStageFlagBits::eTransfer;
+        break;
+    case vk::ImageLayout::eTransferDstOptimal:
+        access = vk::AccessFlagBits::eTransferWrite;
+        stages = vk::PipelineStageFlagBits::eTransfer;
+        break;
+    default:
+        throw invalid_argument("unsupported layout transition!");
+    }
+}
+
+void recordImageTransition(vk::CommandBuffer commandBuffer, vk::Image image,
+                           vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout,
+                           vk::ImageAspectFlags aspectMask) {
+    vk::ImageMemoryBarrier barrier{};
+    barrier.sType = vk::StructureType::eImageMemoryBarrier;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspectMask;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // Wait for everything the old layout allowed and make the writes visible
+    // to everything the new one allows. That is more than a single transition
+    // needs, but the barriers are cheap compared to the fractal shaders.
+    vk::PipelineStageFlags sourceStage, destinationStage;
+    layoutAccess(oldLayout, barrier.srcAccessMask, sourceStage);
+    layoutAccess(newLayout, barrier.dstAccessMask, destinationStage);
+
+    commandBuffer.pipelineBarrier(sourceStage, destinationStage, {}, {}, {},
+                                  barrier);
+}
+
 void Texture::createTextureImage(const uint8_t *data,
                                  vk::CommandPool commandPool,
                                  vk::Queue transferQueue) {
@@ -401,6 +454,24 @@ void Texture::createTextureImage(const uint8_t *data,
                           vk::ImageLayout::eShaderReadOnlyOptimal, aspectMask);
 }
 
+vk::DeviceSize bytesPerPixel(vk::Format format) {
+    switch (format) {
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eR32Sfloat:
+        return 4;
+    case vk::Format::eR32G32Sfloat:
+    case vk::Format::eR16G16B16A16Sfloat:
+        return 8;
+    case vk::Format::eR32G32B32A32Sfloat:
+        return 16;
+    default:
+        throw runtime_error("no CPU uploads into this format");
+    }
+}
+
 void OnlineTexture::createTextureImage(vk::CommandPool commandPool,
                                        vk::Queue transferQueue,
                                        vk::ImageUsageFlags moreFlags) {
@@ -422,10 +493,8 @@ void OnlineTexture::createTextureImage(vk::CommandPool commandPool,
                 vk::MemoryPropertyFlagBits::eDeviceLocal, textureImage,
                 textureImageMemory);
 
-    buf = make_shared<Buffer>(device, w * h * 4,
-                              vk::BufferUsageFlagBits::eTransferSrc,
-                              vk::MemoryPropertyFlagBits::eHostVisible |
-                                  vk::MemoryPropertyFlagBits::eHostCoherent);
+    // The staging buffer is only allocated by the first upload from the CPU,
+    // textures written by the GPU never need one.
 
     // Transition: undefined → transfer destination:
     layout = vk::ImageLayout::eUndefined;
@@ -440,12 +509,30 @@ void OnlineTexture::transitionTo(vk::ImageLayout l) {
     layout = l;
 }
 
+void OnlineTexture::transitionTo(vk::CommandBuffer commandBuffer,
+                                 vk::ImageLayout l) {
+    // also a barrier if the layout stays the same, e.g. after a render pass
+    recordImageTransition(commandBuffer, *textureImage, layout, l, aspectMask);
+    layout = l;
+}
+
 void OnlineTexture::transitionToRead() {
     // Transition: transfer destination → shader reading
     transitionTo(vk::ImageLayout::eShaderReadOnlyOptimal);
 }
 
-void OnlineTexture::update(const uint8_t *cpuData) {
+void OnlineTexture::update(const uint8_t *cpuData,
+                           const vector<vk::Rect2D> &rects) {
+    // The transitions and the copy are a single submission, so the queue is
+    // only waited for once
+    SingleTimeCommandManager manager(commandPool, device->handle(),
+                                     transferQueue);
+    record(manager.commandBuffers[0], cpuData, rects);
+}
+
+void OnlineTexture::record(vk::CommandBuffer commandBuffer,
+                           const uint8_t *cpuData,
+                           const vector<vk::Rect2D> &rects) {
     // Unfortunately the driver may not immediately copy the data into the
     // buffer memory, for example because of caching. It is also possible that
     // writes to the buffer are not visible in the mapped memory yet. There are
@@ -455,19 +542,71 @@ void OnlineTexture::update(const uint8_t *cpuData) {
     //    - Call vkFlushMappedMemoryRanges after writing to the mapped memory,
     //      and call vkInvalidateMappedMemoryRanges before reading from the
     //      mapped memory (faster!).
+    const vk::DeviceSize pixel = bytesPerPixel(format);
+    const vk::DeviceSize capacity = vk::DeviceSize(w) * h * pixel;
+    if (!buf)
+        buf = make_shared<Buffer>(
+            device, capacity, vk::BufferUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    vector<vk::BufferImageCopy> regions;
+    vk::DeviceSize offset = 0;
+    for (const vk::Rect2D &rect : rects) {
+        // clipped, CEF may report rects of the old size during a resize
+        const int32_t x0 = std::max(rect.offset.x, 0);
+        const int32_t y0 = std::max(rect.offset.y, 0);
+        const int32_t x1 =
+            std::min(rect.offset.x + int32_t(rect.extent.width), w);
+        const int32_t y1 =
+            std::min(rect.offset.y + int32_t(rect.extent.height), h);
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+
+        const vk::DeviceSize row = vk::DeviceSize(x1 - x0) * pixel;
+        if (offset + row * (y1 - y0) > capacity) {
+            // overlapping rects, the whole image is never more
+            record(commandBuffer, cpuData,
+                   {vk::Rect2D({0, 0}, {uint32_t(w), uint32_t(h)})});
+            return;
+        }
 
-    buf->copyFromCPU(cpuData);
-
-    // Transition: undefined → transfer destination:
-    transitionTo(vk::ImageLayout::eTransferDstOptimal);
-
-    // Execute the buffer to image copy operation
-    copyBufferToImage(device->handle(), commandPool, transferQueue,
-                      buf->handle(), *textureImage, static_cast<uint32_t>(w),
-                      static_cast<uint32_t>(h), layout, aspectMask);
-
-    // Transition: transfer destination → shader reading
-    transitionTo(vk::ImageLayout::eShaderReadOnlyOptimal);
+        vk::BufferImageCopy region{};
+        region.bufferOffset = offset;
+        // the rows of a rect are packed tightly
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = aspectMask;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = vk::Offset3D({x0, y0, 0});
+        region.imageExtent =
+            vk::Extent3D({uint32_t(x1 - x0), uint32_t(y1 - y0), 1});
+        regions.push_back(region);
+
+        const uint8_t *src = cpuData + (vk::DeviceSize(y0) * w + x0) * pixel;
+        if (x0 == 0 && x1 == w) {
+            // full rows are contiguous in both
+            buf->copyFromCPU(src, offset, row * (y1 - y0));
+            offset += row * (y1 - y0);
+        } else {
+            for (int32_t y = y0; y < y1; y++) {
+                buf->copyFromCPU(src, offset, row);
+                src += vk::DeviceSize(w) * pixel;
+                offset += row;
+            }
+        }
+    }
+    if (regions.empty())
+        return;
+
+    // Coming from undefined (the first update), the content outside the rects
+    // is discarded
+    transitionTo(commandBuffer, vk::ImageLayout::eTransferDstOptimal);
+    commandBuffer.copyBufferToImage(buf->handle(), *textureImage, layout,
+                                    regions);
+    transitionTo(commandBuffer, vk::ImageLayout::eShaderReadOnlyOptimal);
 
     /*
         uint64_t size = w * h * 4;
@@ -5,7 +5,7 @@
 void createImage(const LogicalDevice *device, int w, int h, vk::Format format,
                  vk::ImageTiling tiling, vk::ImageUsageFlags usage,
                  vk::MemoryPropertyFlags properties, vk::raii::Image &image,
-                 vk::raii::DeviceMemory &imageMemory);
+                 Allocation &imageMemory);
 
 void transitionImageLayout(const vk::raii::Device &device,
                            vk::CommandPool commandPool, vk::Queue transferQueue,
@@ -13,6 +13,17 @@ void transitionImageLayout(const vk::raii::Device &device,
                            vk::ImageLayout oldLayout,
                            vk::ImageLayout newLayout);
 
+// Records a layout transition into a command buffer that is submitted later,
+// e.g. the one of the frame. Unlike transitionImageLayout, this neither
+// submits nor waits.
+void recordImageTransition(
+    vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout oldLayout,
+    vk::ImageLayout newLayout,
+    vk::ImageAspectFlags aspectMask = vk::ImageAspectFlagBits::eColor);
+
+// The size of a texel of the color formats that are uploaded from the CPU
+vk::DeviceSize bytesPerPixel(vk::Format format);
+
 uint8_t *loadFile(const string &path, int &w, int &h);
 
 inline vk::raii::ImageView createImageView(const vk::raii::Device &device,
@@ -57,7 +68,7 @@ class Texture : private boost::noncopyable {
     Texture(shared_ptr<LogicalDevice> device, const uint8_t *data, int w, int h,
             vk::CommandPool commandPool, vk::Queue transferQueue)
         : device(device), w(w), h(h), textureImageView(0), textureImage(0),
-          aspectMask(vk::ImageAspectFlagBits::eColor), textureImageMemory(0) {
+          aspectMask(vk::ImageAspectFlagBits::eColor), textureImageMemory(nullptr) {
         createTextureImage(data, commandPool, transferQueue);
         textureImageView =
             createImageView(device->device, *textureImage,
@@ -89,7 +100,7 @@ class Texture : private boost::noncopyable {
     const shared_ptr<LogicalDevice> device;
     vk::raii::ImageView textureImageView;
     vk::raii::Image textureImage;
-    vk::raii::DeviceMemory textureImageMemory;
+    Allocation textureImageMemory;
 };
 
 class OnlineTexture : private boost::noncopyable {
@@ -102,7 +113,7 @@ class OnlineTexture : private boost::noncopyable {
         vk::ImageAspectFlags aspectMask = vk::ImageAspectFlagBits::eColor)
         : device(device), w(w), h(h), commandPool(commandPool), format(format),
           aspectMask(aspectMask), transferQueue(*device->transferQueue),
-          textureImageView(0), textureImage(0), textureImageMemory(0) {
+          textureImageView(0), textureImage(0), textureImageMemory(nullptr) {
         createTextureImage(commandPool, transferQueue, moreFlags);
         textureImageView =
             createImageView(device->device, *textureImage, format, aspectMask);
@@ -117,10 +128,24 @@ class OnlineTexture : private boost::noncopyable {
     vk::ImageView imageView() const { return *textureImageView; }
     vk::Image image() const { return *textureImage; }
 
-    void update(const uint8_t *data);
+    // data has all w * h pixels, but only the pixels in rects are uploaded.
+    // The rects are packed into the staging buffer and copied with one
+    // command buffer, i.e. a blinking cursor doesn't upload the whole window.
+    void update(const uint8_t *data, const vector<vk::Rect2D> &rects);
+    void update(const uint8_t *data) {
+        update(data, {vk::Rect2D({0, 0}, {uint32_t(w), uint32_t(h)})});
+    }
+    // Records the upload instead of submitting it. The staging buffer is
+    // written right away, so it must not be in use by an earlier upload.
+    void record(vk::CommandBuffer commandBuffer, const uint8_t *data,
+                const vector<vk::Rect2D> &rects);
 
     void transitionToRead();
     void transitionTo(vk::ImageLayout l);
+    // Records the transition into the command buffer. The layout is tracked
+    // as if it was already executed, so the command buffer must be submitted
+    // before the texture is used otherwise.
+    void transitionTo(vk::CommandBuffer commandBuffer, vk::ImageLayout l);
 
     vk::ImageLayout imageLayout() { return layout; }
 
@@ -145,8 +170,9 @@ class OnlineTexture : private boost::noncopyable {
     const shared_ptr<LogicalDevice> device;
     vk::raii::ImageView textureImageView;
     vk::raii::Image textureImage;
-    vk::raii::DeviceMemory textureImageMemory;
+    Allocation textureImageMemory;
 
+    // w * h pixels of format, allocated by the first record()
     shared_ptr<Buffer> buf;
 };
 
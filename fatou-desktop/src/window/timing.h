@@ -157,14 +157,12 @@ class TimeQueryPool {
     }
 
     // must be called before beginRenderPass
-    void start(vk::CommandBuffer commandBuffer, const uint32_t id,
-               const uint64_t userdata) {
+    void start(vk::CommandBuffer commandBuffer, const uint32_t id) {
         assert(id < phases);
 
         // reset cache
         results[id].reset();
-        this->userdata[id] = userdata;
-        this->loaded[id] = true;
+        this->userdata[id].reset();
 
         // There's an implicit execution dependency for these query-related
         // commands, so the reset will finish before the timestamps are written.
@@ -173,10 +171,15 @@ class TimeQueryPool {
                                      *timeQueryPool, id * 2);
     }
 
-    // must be called directly after endRenderPass
-    void stop(vk::CommandBuffer commandBuffer, const uint32_t id) {
+    // must be called directly after endRenderPass. The userdata (e.g. the
+    // number of samples) is returned with the time.
+    void stop(vk::CommandBuffer commandBuffer, const uint32_t id,
+              const uint64_t userdata) {
         assert(id < phases);
 
+        this->userdata[id] = userdata;
+        this->loaded[id] = true;
+
         commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
                                      *timeQueryPool, id * 2 + 1);
     }
@@ -4,10 +4,12 @@
 
 #include "ubo.h"
 
+// The uniform buffers of all layouts are dynamic, see UniformRing
+
 void DescriptorSetLayout::createDescriptorSetLayout() {
     vk::DescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
+    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 
     //  It is possible for the shader variable to represent an array of
     //  uniform buffer objects, and descriptorCount specifies the number of
@@ -51,7 +53,7 @@ void DescriptorSetLayout::createDescriptorSetLayout() {
 void DescriptorSetLayoutVertexOnly::createDescriptorSetLayout() {
     vk::DescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
+    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 
     //  It is possible for the shader variable to represent an array of
     //  uniform buffer objects, and descriptorCount specifies the number of
@@ -80,7 +82,7 @@ void DescriptorSetLayoutVertexOnly::createDescriptorSetLayout() {
 void MandelDescriptorSetLayout::createDescriptorSetLayout() {
     vk::DescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
+    uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 
     //  It is possible for the shader variable to represent an array of
     //  uniform buffer objects, and descriptorCount specifies the number of
@@ -101,7 +103,7 @@ void MandelDescriptorSetLayout::createDescriptorSetLayout() {
     fragmentUboLayoutBinding.binding = 1;
     fragmentUboLayoutBinding.descriptorCount = 1;
     fragmentUboLayoutBinding.descriptorType =
-        vk::DescriptorType::eUniformBuffer;
+        vk::DescriptorType::eUniformBufferDynamic;
     fragmentUboLayoutBinding.pImmutableSamplers = nullptr;
     fragmentUboLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
 
@@ -117,25 +119,118 @@ void MandelDescriptorSetLayout::createDescriptorSetLayout() {
     descriptorSetLayout = device->device.createDescriptorSetLayout(layoutInfo);
 }
 
+void PerturbationDescriptorSetLayout::createDescriptorSetLayout() {
+    std::array<vk::DescriptorSetLayoutBinding, 4> bindings{};
+
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    // the reference orbit. Storage buffers can be much larger than uniform
+    // buffers (which might be limited to 64kb) and support runtime-sized
+    // arrays.
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    // bilinear approximation table
+    bindings[3].binding = 3;
+    bindings[3].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[3].descriptorCount = 1;
+    bindings[3].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = vk::StructureType::eDescriptorSetLayoutCreateInfo;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    descriptorSetLayout = device->device.createDescriptorSetLayout(layoutInfo);
+}
+
+void ColorizeDescriptorSetLayout::createDescriptorSetLayout() {
+    std::array<vk::DescriptorSetLayoutBinding, 3> bindings{};
+
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = vk::ShaderStageFlagBits::eVertex;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = vk::StructureType::eDescriptorSetLayoutCreateInfo;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    descriptorSetLayout = device->device.createDescriptorSetLayout(layoutInfo);
+}
+
+void ComputeDescriptorSetLayout::createDescriptorSetLayout() {
+    std::array<vk::DescriptorSetLayoutBinding, 4> bindings{};
+
+    bindings[0].binding = 1;
+    bindings[0].descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    // reference orbit and bilinear approximation table
+    bindings[1].binding = 2;
+    bindings[1].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    bindings[2].binding = 3;
+    bindings[2].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    bindings[3].binding = 4;
+    bindings[3].descriptorType = vk::DescriptorType::eStorageImage;
+    bindings[3].descriptorCount = 1;
+    bindings[3].stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = vk::StructureType::eDescriptorSetLayoutCreateInfo;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    descriptorSetLayout = device->device.createDescriptorSetLayout(layoutInfo);
+}
+
 void DescriptorPool::update(uint32_t currentImage, const Extent2D extent,
                             const UniformBufferObject &ubo) {
-    // PLEASE NOTE: Using a UBO this way is not the most efficient way to pass
-    // frequently changing values to the shader. A more efficient way to pass a
-    // small buffer of data to shaders are push constants.
+    uniformBuffer->write(currentImage, ubo);
+}
 
-    uniformBuffers[currentImage]->copyFromCPU(&ubo);
+void DescriptorPool::updateColors(uint32_t currentImage,
+                                  const ColorUniformBufferObject &colors) {
+    assert(colorize);
+    colorBuffer->write(currentImage, colors);
 }
 
 void DescriptorPool::createUniformBuffers() {
-    vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
+    // One buffer for all frames in flight, each frame binds its own slots
+    uniformBuffer = make_shared<UniformRing<UniformBufferObject>>(
+        device, MAX_FRAMES_IN_FLIGHT);
 
-    // uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        uniformBuffers.push_back(make_shared<Buffer>(
-            device, bufferSize, vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-                vk::MemoryPropertyFlagBits::eHostCoherent));
+    if (colorize) {
+        colorBuffer = make_shared<UniformRing<ColorUniformBufferObject>>(
+            device, MAX_FRAMES_IN_FLIGHT);
     }
 }
 
@@ -153,18 +248,20 @@ void DescriptorPool::createDescriptorPool() {
     // if the allocation succeeds on some machines, but fails on others.
 
     std::array<vk::DescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[0].type = vk::DescriptorType::eUniformBufferDynamic;
+    poolSizes[0].descriptorCount = colorize ? 2 : 1;
     poolSizes[1].type = vk::DescriptorType::eCombinedImageSampler;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[1].descriptorCount = 1;
 
     vk::DescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = vk::StructureType::eDescriptorPoolCreateInfo;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
 
-    // Maximum number of descriptor sets that may be allocated
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    // Maximum number of descriptor sets that may be allocated. The frames in
+    // flight share the set, they bind different offsets of the uniform
+    // buffers.
+    poolInfo.maxSets = 1;
 
     // The structure has an optional flag similar to command pools that
     // determines if individual descriptor sets can be freed or not:
@@ -174,57 +271,144 @@ void DescriptorPool::createDescriptorPool() {
     descriptorPool = device->device.createDescriptorPool(poolInfo);
 }
 
-void DescriptorPool::createDescriptorSets(
+void DescriptorPool::createDescriptorSet(
     vk::DescriptorSetLayout descriptorSetLayout, vk::ImageView textureImageView,
     vk::Sampler textureSampler) {
-    std::vector<vk::DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-                                                 descriptorSetLayout);
+    std::vector<vk::DescriptorSetLayout> layouts(1, descriptorSetLayout);
     vk::DescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = vk::StructureType::eDescriptorSetAllocateInfo;
     allocInfo.descriptorPool = *descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = 1;
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSets = device->device.allocateDescriptorSets(allocInfo);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i]->handle();
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        vk::DescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureSampler;
-
-        std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
-        descriptorWrites[0].sType = vk::StructureType::eWriteDescriptorSet;
-        descriptorWrites[0].dstSet = *descriptorSets[i];
-        // We gave our uniform buffer binding index 0
-        descriptorWrites[0].dstBinding = 0;
-        // Remember that descriptors can be arrays, so we also need to specify
-        // the first index in the array that we want to update.
-        descriptorWrites[0].dstArrayElement = 0;
-
-        descriptorWrites[0].descriptorType = vk::DescriptorType::eUniformBuffer;
-        descriptorWrites[0].descriptorCount = 1;
-
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        descriptorWrites[0].pImageInfo = nullptr;       // Optional
-        descriptorWrites[0].pTexelBufferView = nullptr; // Optional
-
-        descriptorWrites[1].sType = vk::StructureType::eWriteDescriptorSet;
-        descriptorWrites[1].dstSet = *descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType =
-            vk::DescriptorType::eCombinedImageSampler;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = nullptr; // Optional
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pTexelBufferView = nullptr; // Optional
-
-        device->device.updateDescriptorSets(descriptorWrites, {});
+    descriptorSet = device->device.allocateDescriptorSets(allocInfo);
+
+    const vk::DescriptorBufferInfo bufferInfo = uniformBuffer->info();
+
+    vk::DescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    imageInfo.imageView = textureImageView;
+    imageInfo.sampler = textureSampler;
+
+    std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
+    descriptorWrites[0].sType = vk::StructureType::eWriteDescriptorSet;
+    descriptorWrites[0].dstSet = *descriptorSet[0];
+    // We gave our uniform buffer binding index 0
+    descriptorWrites[0].dstBinding = 0;
+    // Remember that descriptors can be arrays, so we also need to specify
+    // the first index in the array that we want to update.
+    descriptorWrites[0].dstArrayElement = 0;
+
+    descriptorWrites[0].descriptorType =
+        vk::DescriptorType::eUniformBufferDynamic;
+    descriptorWrites[0].descriptorCount = 1;
+
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+    descriptorWrites[0].pImageInfo = nullptr;       // Optional
+    descriptorWrites[0].pTexelBufferView = nullptr; // Optional
+
+    descriptorWrites[1].sType = vk::StructureType::eWriteDescriptorSet;
+    descriptorWrites[1].dstSet = *descriptorSet[0];
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType =
+        vk::DescriptorType::eCombinedImageSampler;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = nullptr; // Optional
+    descriptorWrites[1].pImageInfo = &imageInfo;
+    descriptorWrites[1].pTexelBufferView = nullptr; // Optional
+
+    device->device.updateDescriptorSets(descriptorWrites, {});
+
+    if (colorize) {
+        const vk::DescriptorBufferInfo colorInfo = colorBuffer->info();
+
+        vk::WriteDescriptorSet colorWrite{};
+        colorWrite.sType = vk::StructureType::eWriteDescriptorSet;
+        colorWrite.dstSet = *descriptorSet[0];
+        colorWrite.dstBinding = 2;
+        colorWrite.dstArrayElement = 0;
+        colorWrite.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+        colorWrite.descriptorCount = 1;
+        colorWrite.pBufferInfo = &colorInfo;
+
+        device->device.updateDescriptorSets(colorWrite, {});
     }
 }
+
+void ComputeDescriptorPool::updateStorage(uint32_t binding, vk::Buffer buffer,
+                                          vk::DeviceSize range) {
+    vk::DescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = range;
+
+    vk::WriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = vk::StructureType::eWriteDescriptorSet;
+    descriptorWrite.dstSet = *descriptorSet[0];
+    descriptorWrite.dstBinding = binding;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    device->device.updateDescriptorSets(descriptorWrite, {});
+}
+
+void ComputeDescriptorPool::createDescriptorPool() {
+    std::array<vk::DescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = vk::DescriptorType::eUniformBufferDynamic;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = vk::DescriptorType::eStorageBuffer;
+    poolSizes[1].descriptorCount = maxStorageBuffers;
+    poolSizes[2].type = vk::DescriptorType::eStorageImage;
+    poolSizes[2].descriptorCount = 1;
+
+    vk::DescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = vk::StructureType::eDescriptorPoolCreateInfo;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+
+    descriptorPool = device->device.createDescriptorPool(poolInfo);
+}
+
+void ComputeDescriptorPool::createDescriptorSet(
+    vk::DescriptorSetLayout descriptorSetLayout, vk::ImageView target) {
+    std::vector<vk::DescriptorSetLayout> layouts(1, descriptorSetLayout);
+    vk::DescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = vk::StructureType::eDescriptorSetAllocateInfo;
+    allocInfo.descriptorPool = *descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = layouts.data();
+
+    descriptorSet = device->device.allocateDescriptorSets(allocInfo);
+
+    const vk::DescriptorBufferInfo bufferInfo = uniformBuffer->info();
+
+    // storage images have no sampler
+    vk::DescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = vk::ImageLayout::eGeneral;
+    imageInfo.imageView = target;
+
+    std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
+    descriptorWrites[0].sType = vk::StructureType::eWriteDescriptorSet;
+    descriptorWrites[0].dstSet = *descriptorSet[0];
+    descriptorWrites[0].dstBinding = 1;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType =
+        vk::DescriptorType::eUniformBufferDynamic;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    descriptorWrites[1].sType = vk::StructureType::eWriteDescriptorSet;
+    descriptorWrites[1].dstSet = *descriptorSet[0];
+    descriptorWrites[1].dstBinding = 4;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = vk::DescriptorType::eStorageImage;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &imageInfo;
+
+    device->device.updateDescriptorSets(descriptorWrites, {});
+}
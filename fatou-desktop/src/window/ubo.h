@@ -24,6 +24,8 @@ struct UniformBufferObject2 {
     alignas(16) glm::dvec2 pos;
     alignas(8) double zoom;
     alignas(4) int iter;
+    // iGamma, shift, contrast, phase and smoothing are applied by the
+    // compositor (see ColorUniformBufferObject), they only keep the offsets
     alignas(4) float iGamma;
     alignas(4) float play;
     alignas(4) float shift;
@@ -31,6 +33,89 @@ struct UniformBufferObject2 {
     alignas(4) float phase;
     alignas(4) float radius;
     alignas(4) float smoothing;
+
+    // Only used by the perturbation shaders: offset of the viewport center to
+    // the reference point. Shaders that don't need it just don't declare it.
+    alignas(16) glm::dvec2 refOffset;
+
+    // The same for zooms beyond the range of doubles (mandelfe.frag):
+    // zoom = zoomMantissa * 2^zoomExponent and
+    // refOffset = refOffsetScaled * 2^zoomExponent
+    alignas(8) glm::vec2 refOffsetScaled;
+    alignas(4) float zoomMantissa;
+    alignas(4) int32_t zoomExponent;
+
+    // pos = pos + posLo for double-doubles (PRECISION_DOUBLE_DOUBLE in
+    // mandel.frag)
+    alignas(16) glm::dvec2 posLo;
+    // pos as pairs of floats (x.hi, x.lo, y.hi, y.lo) for mandel.frag
+    // without doubles
+    alignas(16) glm::vec4 posFF;
+};
+
+// Parameters of colorize.frag, which colours the iteration counts of the
+// fractal layers when they are presented
+struct ColorUniformBufferObject {
+    alignas(4) float iGamma;
+    alignas(4) float shift;
+    alignas(4) float contrast;
+    alignas(4) float phase;
+    alignas(4) float smoothing;
+};
+
+// Writes of one descriptor pool that may happen while recording a frame, e.g.
+// one per strip that is rendered into the same layer
+static constexpr size_t uniformSlotsPerFrame = 16;
+
+// A uniform buffer with a few slots for every frame in flight, bound as
+// dynamic uniform buffer. Each write goes to the next slot of its frame, so
+// neither the other frame in flight nor the draws recorded earlier in the same
+// frame see it. The memory stays mapped, see MemoryAllocator.
+template <class T> class UniformRing : private boost::noncopyable {
+  public:
+    UniformRing(shared_ptr<LogicalDevice> device, size_t frames)
+        : frames(frames), stride(slotSize(*device)), cursor(frames, 0) {
+        buffer = make_shared<Buffer>(
+            device, stride * frames * uniformSlotsPerFrame,
+            vk::BufferUsageFlagBits::eUniformBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    // the next bind uses the value
+    void write(uint32_t frame, const T &value) {
+        assert(frame < frames);
+        const size_t slot = frame * uniformSlotsPerFrame +
+                            cursor[frame]++ % uniformSlotsPerFrame;
+        current = uint32_t(slot * stride);
+        buffer->copyFromCPU(&value, current, sizeof(T));
+    }
+
+    // dynamic offset of the last write
+    uint32_t offset() const { return current; }
+
+    // The descriptor covers one slot, the offset is added when binding
+    vk::DescriptorBufferInfo info() const {
+        vk::DescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = buffer->handle();
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(T);
+        return bufferInfo;
+    }
+
+  private:
+    // dynamic offsets must be multiples of the alignment (a power of two)
+    static vk::DeviceSize slotSize(const LogicalDevice &device) {
+        const vk::DeviceSize alignment =
+            device.physical->properties.limits.minUniformBufferOffsetAlignment;
+        return (sizeof(T) + alignment - 1) & ~(alignment - 1);
+    }
+
+    const size_t frames;
+    const vk::DeviceSize stride;
+    shared_ptr<Buffer> buffer;
+    vector<size_t> cursor;
+    uint32_t current = 0;
 };
 
 class DescriptorSetLayout {
@@ -83,6 +168,56 @@ class MandelDescriptorSetLayout {
     const shared_ptr<LogicalDevice> device;
 };
 
+// Like MandelDescriptorSetLayout, but with additional storage buffers for the
+// perturbation shaders: the reference orbits at binding 2 and the bilinear
+// approximation table at binding 3.
+class PerturbationDescriptorSetLayout {
+  public:
+    PerturbationDescriptorSetLayout(shared_ptr<LogicalDevice> device)
+        : device(device) {
+        createDescriptorSetLayout();
+    }
+    void createDescriptorSetLayout();
+
+    vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+
+  private:
+    const shared_ptr<LogicalDevice> device;
+};
+
+// Like DescriptorSetLayout, plus the ColorUniformBufferObject at binding 2
+class ColorizeDescriptorSetLayout {
+  public:
+    ColorizeDescriptorSetLayout(shared_ptr<LogicalDevice> device)
+        : device(device) {
+        createDescriptorSetLayout();
+    }
+    void createDescriptorSetLayout();
+
+    vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+
+  private:
+    const shared_ptr<LogicalDevice> device;
+};
+
+// Layout of the compute backend (interlace.comp): the UniformBufferObject2 at
+// binding 1, the storage buffers of the perturbation shaders at bindings 2 and
+// 3, and the layer the shader writes to at binding 4. Shaders that don't use
+// the storage buffers just don't declare them.
+class ComputeDescriptorSetLayout {
+  public:
+    ComputeDescriptorSetLayout(shared_ptr<LogicalDevice> device)
+        : device(device) {
+        createDescriptorSetLayout();
+    }
+    void createDescriptorSetLayout();
+
+    vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
+
+  private:
+    const shared_ptr<LogicalDevice> device;
+};
+
 class DescriptorPool {
     // Unlike vertex and index buffers, descriptor sets are not unique to
     // graphics pipelines.
@@ -97,13 +232,14 @@ class DescriptorPool {
     DescriptorPool(size_t MAX_FRAMES_IN_FLIGHT,
                    shared_ptr<LogicalDevice> device,
                    vk::DescriptorSetLayout descriptorSetLayout,
-                   vk::ImageView textureImageView, vk::Sampler textureSampler)
+                   vk::ImageView textureImageView, vk::Sampler textureSampler,
+                   bool colorize = false)
         : MAX_FRAMES_IN_FLIGHT(MAX_FRAMES_IN_FLIGHT), device(device),
-          descriptorPool(0) {
+          colorize(colorize), descriptorPool(0) {
         createUniformBuffers();
         createDescriptorPool();
-        createDescriptorSets(descriptorSetLayout, textureImageView,
-                             textureSampler);
+        createDescriptorSet(descriptorSetLayout, textureImageView,
+                            textureSampler);
     };
 
     ~DescriptorPool() {
@@ -115,40 +251,53 @@ class DescriptorPool {
     void update(uint32_t currentImage, const Extent2D extent,
                 const UniformBufferObject &ubo);
 
-    void bind(vk::CommandBuffer commandBuffer, uint32_t currentFrame,
+    // only for pools of a ColorizeDescriptorSetLayout
+    void updateColors(uint32_t currentImage,
+                      const ColorUniformBufferObject &colors);
+
+    // binds the values of the last updates
+    void bind(vk::CommandBuffer commandBuffer,
               vk::PipelineLayout pipelineLayout) {
+        // in the order of the bindings
+        std::array<uint32_t, 2> offsets = {uniformBuffer->offset()};
+        if (colorize)
+            offsets[1] = colorBuffer->offset();
+
         commandBuffer.bindDescriptorSets(
             vk::PipelineBindPoint::eGraphics, pipelineLayout,
-            0,                                // index of first descriptor set
-            1,                                // number of sets to bind
-            &(*descriptorSets[currentFrame]), // array of sets to bind
-            0,                                // for dynamic descriptors
-            nullptr);
+            0,                    // index of first descriptor set
+            1,                    // number of sets to bind
+            &(*descriptorSet[0]), // array of sets to bind
+            colorize ? 2 : 1,     // for dynamic descriptors
+            offsets.data());
     }
 
   private:
     void createUniformBuffers();
     void createDescriptorPool();
-    void createDescriptorSets(vk::DescriptorSetLayout descriptorSetLayout,
-                              vk::ImageView textureImageView,
-                              vk::Sampler textureSampler);
+    void createDescriptorSet(vk::DescriptorSetLayout descriptorSetLayout,
+                             vk::ImageView textureImageView,
+                             vk::Sampler textureSampler);
 
   private:
     const size_t MAX_FRAMES_IN_FLIGHT;
     const shared_ptr<LogicalDevice> device;
+    const bool colorize;
 
     vk::raii::DescriptorPool descriptorPool;
-    vector<vk::raii::DescriptorSet> descriptorSets;
+    vector<vk::raii::DescriptorSet> descriptorSet;
 
-    vector<shared_ptr<Buffer>> uniformBuffers;
+    shared_ptr<UniformRing<UniformBufferObject>> uniformBuffer;
+    shared_ptr<UniformRing<ColorUniformBufferObject>> colorBuffer;
 };
 
 template <class UBO1, class UBO2> class DefaultDescriptorPool {
   public:
     DefaultDescriptorPool(shared_ptr<LogicalDevice> device,
-                          vk::DescriptorSetLayout descriptorSetLayout)
+                          vk::DescriptorSetLayout descriptorSetLayout,
+                          size_t framesInFlight)
         : device(device), descriptorPool(0) {
-        createUniformBuffer();
+        createUniformBuffer(framesInFlight);
         createDescriptorPool();
         createDescriptorSet(descriptorSetLayout);
     };
@@ -160,55 +309,66 @@ template <class UBO1, class UBO2> class DefaultDescriptorPool {
         //  nullptr);
     }
 
-    void updateVertex(const UBO1 &ubo) {
-        // PLEASE NOTE: Using a UBO this way is not the most efficient way to
-        // pass frequently changing values to the shader. A more efficient way
-        // to pass a small buffer of data to shaders are push constants.
-
-        uniformBuffer->copyFromCPU(&ubo);
+    // Push constants would be even cheaper, but both UBOs together are larger
+    // than the 128 bytes every device supports. The rings stay mapped and
+    // never overwrite a value that a pending draw uses.
+    void updateVertex(uint32_t frame, const UBO1 &ubo) {
+        uniformBuffer->write(frame, ubo);
     }
 
-    void updateFragment(const UBO2 &ubo2) {
-        // PLEASE NOTE: Using a UBO this way is not the most efficient way to
-        // pass frequently changing values to the shader. A more efficient way
-        // to pass a small buffer of data to shaders are push constants.
+    void updateFragment(uint32_t frame, const UBO2 &ubo2) {
+        uniformBuffer2->write(frame, ubo2);
+    }
 
-        uniformBuffer2->copyFromCPU(&ubo2);
+    // Points a storage buffer binding to the given buffer. The descriptor set
+    // must not be in use by a pending command buffer!
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range) {
+        vk::DescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = range;
+
+        vk::WriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = vk::StructureType::eWriteDescriptorSet;
+        descriptorWrite.dstSet = *descriptorSet[0];
+        descriptorWrite.dstBinding = binding;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        device->device.updateDescriptorSets(descriptorWrite, {});
     }
 
+    // binds the values of the last updates
     void bind(vk::CommandBuffer commandBuffer,
               vk::PipelineLayout pipelineLayout) {
+        const std::array<uint32_t, 2> offsets = {uniformBuffer->offset(),
+                                                 uniformBuffer2->offset()};
         commandBuffer.bindDescriptorSets(
             vk::PipelineBindPoint::eGraphics, pipelineLayout,
             0,                    // index of first descriptor set
             1,                    // number of sets to bind
             &(*descriptorSet[0]), // array of sets to bind
-            0,                    // for dynamic descriptors
-            nullptr);
+            2,                    // for dynamic descriptors
+            offsets.data());
     }
 
   private:
-    void createUniformBuffer() {
-        vk::DeviceSize bufferSize = sizeof(UBO1);
-
-        uniformBuffer = make_shared<Buffer>(
-            device, bufferSize, vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-                vk::MemoryPropertyFlagBits::eHostCoherent);
-
-        vk::DeviceSize bufferSize2 = sizeof(UBO2);
-
-        uniformBuffer2 = make_shared<Buffer>(
-            device, bufferSize2, vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-                vk::MemoryPropertyFlagBits::eHostCoherent);
+    void createUniformBuffer(size_t framesInFlight) {
+        uniformBuffer = make_shared<UniformRing<UBO1>>(device, framesInFlight);
+        uniformBuffer2 = make_shared<UniformRing<UBO2>>(device, framesInFlight);
     }
 
     void createDescriptorPool() {
 
-        std::array<vk::DescriptorPoolSize, 1> poolSizes{};
-        poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
+        std::array<vk::DescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = vk::DescriptorType::eUniformBufferDynamic;
         poolSizes[0].descriptorCount = 2;
+        // for layouts with additional buffers, e.g. the reference orbit
+        poolSizes[1].type = vk::DescriptorType::eStorageBuffer;
+        poolSizes[1].descriptorCount = maxStorageBuffers;
 
         vk::DescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = vk::StructureType::eDescriptorPoolCreateInfo;
@@ -241,10 +401,7 @@ template <class UBO1, class UBO2> class DefaultDescriptorPool {
 
         ////////
 
-        vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffer->handle();
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UBO1);
+        const vk::DescriptorBufferInfo bufferInfo = uniformBuffer->info();
 
         descriptorWrites[i].sType = vk::StructureType::eWriteDescriptorSet;
         descriptorWrites[i].dstSet = *descriptorSet[0];
@@ -254,7 +411,8 @@ template <class UBO1, class UBO2> class DefaultDescriptorPool {
         // the first index in the array that we want to update.
         descriptorWrites[i].dstArrayElement = 0;
 
-        descriptorWrites[i].descriptorType = vk::DescriptorType::eUniformBuffer;
+        descriptorWrites[i].descriptorType =
+            vk::DescriptorType::eUniformBufferDynamic;
         descriptorWrites[i].descriptorCount = 1;
 
         descriptorWrites[i].pBufferInfo = &bufferInfo;
@@ -263,17 +421,15 @@ template <class UBO1, class UBO2> class DefaultDescriptorPool {
 
         ////////
 
-        vk::DescriptorBufferInfo bufferInfo2{};
-        bufferInfo2.buffer = uniformBuffer2->handle();
-        bufferInfo2.offset = 0;
-        bufferInfo2.range = sizeof(UBO2);
+        const vk::DescriptorBufferInfo bufferInfo2 = uniformBuffer2->info();
 
         i = 1;
         descriptorWrites[i].sType = vk::StructureType::eWriteDescriptorSet;
         descriptorWrites[i].dstSet = *descriptorSet[0];
         descriptorWrites[i].dstBinding = 1;
         descriptorWrites[i].dstArrayElement = 0;
-        descriptorWrites[i].descriptorType = vk::DescriptorType::eUniformBuffer;
+        descriptorWrites[i].descriptorType =
+            vk::DescriptorType::eUniformBufferDynamic;
         descriptorWrites[i].descriptorCount = 1;
         descriptorWrites[i].pBufferInfo = &bufferInfo2;
         descriptorWrites[i].pImageInfo = nullptr;       // Optional
@@ -283,21 +439,24 @@ template <class UBO1, class UBO2> class DefaultDescriptorPool {
     }
 
   private:
+    static constexpr uint32_t maxStorageBuffers = 4;
+
     const shared_ptr<LogicalDevice> device;
 
     vk::raii::DescriptorPool descriptorPool;
     vector<vk::raii::DescriptorSet> descriptorSet;
 
-    shared_ptr<Buffer> uniformBuffer;
-    shared_ptr<Buffer> uniformBuffer2;
+    shared_ptr<UniformRing<UBO1>> uniformBuffer;
+    shared_ptr<UniformRing<UBO2>> uniformBuffer2;
 };
 
 template <class UBO1, class UBO2> class DefaultDescriptorPoolVertex {
   public:
     DefaultDescriptorPoolVertex(shared_ptr<LogicalDevice> device,
-                                vk::DescriptorSetLayout descriptorSetLayout)
+                                vk::DescriptorSetLayout descriptorSetLayout,
+                                size_t framesInFlight)
         : device(device), descriptorPool(0) {
-        createUniformBuffer();
+        createUniformBuffer(framesInFlight);
         createDescriptorPool();
         createDescriptorSet(descriptorSetLayout);
     };
@@ -309,41 +468,35 @@ template <class UBO1, class UBO2> class DefaultDescriptorPoolVertex {
         //  nullptr);
     }
 
-    void updateVertex(const UBO1 &ubo) {
-        // PLEASE NOTE: Using a UBO this way is not the most efficient way to
-        // pass frequently changing values to the shader. A more efficient way
-        // to pass a small buffer of data to shaders are push constants.
-
-        uniformBuffer->copyFromCPU(&ubo);
+    void updateVertex(uint32_t frame, const UBO1 &ubo) {
+        uniformBuffer->write(frame, ubo);
     }
 
     // TODO: remove
-    void updateFragment(const UBO2 &ubo) {}
+    void updateFragment(uint32_t frame, const UBO2 &ubo) {}
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range) {}
 
     void bind(vk::CommandBuffer commandBuffer,
               vk::PipelineLayout pipelineLayout) {
+        const uint32_t offset = uniformBuffer->offset();
         commandBuffer.bindDescriptorSets(
             vk::PipelineBindPoint::eGraphics, pipelineLayout,
             0,                    // index of first descriptor set
             1,                    // number of sets to bind
             &(*descriptorSet[0]), // array of sets to bind
-            0,                    // for dynamic descriptors
-            nullptr);
+            1,                    // for dynamic descriptors
+            &offset);
     }
 
   private:
-    void createUniformBuffer() {
-        vk::DeviceSize bufferSize = sizeof(UBO1);
-
-        uniformBuffer = make_shared<Buffer>(
-            device, bufferSize, vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-                vk::MemoryPropertyFlagBits::eHostCoherent);
+    void createUniformBuffer(size_t framesInFlight) {
+        uniformBuffer = make_shared<UniformRing<UBO1>>(device, framesInFlight);
     }
 
     void createDescriptorPool() {
         std::array<vk::DescriptorPoolSize, 1> poolSizes{};
-        poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
+        poolSizes[0].type = vk::DescriptorType::eUniformBufferDynamic;
         poolSizes[0].descriptorCount = 1;
 
         vk::DescriptorPoolCreateInfo poolInfo{};
@@ -377,10 +530,7 @@ template <class UBO1, class UBO2> class DefaultDescriptorPoolVertex {
 
         ////////
 
-        vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffer->handle();
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UBO1);
+        const vk::DescriptorBufferInfo bufferInfo = uniformBuffer->info();
 
         descriptorWrites[i].sType = vk::StructureType::eWriteDescriptorSet;
         descriptorWrites[i].dstSet = *descriptorSet[0];
@@ -390,7 +540,8 @@ template <class UBO1, class UBO2> class DefaultDescriptorPoolVertex {
         // the first index in the array that we want to update.
         descriptorWrites[i].dstArrayElement = 0;
 
-        descriptorWrites[i].descriptorType = vk::DescriptorType::eUniformBuffer;
+        descriptorWrites[i].descriptorType =
+            vk::DescriptorType::eUniformBufferDynamic;
         descriptorWrites[i].descriptorCount = 1;
 
         descriptorWrites[i].pBufferInfo = &bufferInfo;
@@ -408,5 +559,53 @@ template <class UBO1, class UBO2> class DefaultDescriptorPoolVertex {
     vk::raii::DescriptorPool descriptorPool;
     vector<vk::raii::DescriptorSet> descriptorSet;
 
-    shared_ptr<Buffer> uniformBuffer;
+    shared_ptr<UniformRing<UBO1>> uniformBuffer;
+};
+
+// Descriptor set of one layer of the compute backend, see
+// ComputeDescriptorSetLayout. The image must be in the general layout while
+// the shader runs.
+class ComputeDescriptorPool {
+  public:
+    ComputeDescriptorPool(shared_ptr<LogicalDevice> device,
+                          vk::DescriptorSetLayout descriptorSetLayout,
+                          vk::ImageView target, size_t framesInFlight)
+        : device(device), descriptorPool(0) {
+        uniformBuffer = make_shared<UniformRing<UniformBufferObject2>>(
+            device, framesInFlight);
+        createDescriptorPool();
+        createDescriptorSet(descriptorSetLayout, target);
+    }
+
+    void updateFragment(uint32_t frame, const UniformBufferObject2 &ubo2) {
+        uniformBuffer->write(frame, ubo2);
+    }
+
+    // Points a storage buffer binding to the given buffer. The descriptor set
+    // must not be in use by a pending command buffer!
+    void updateStorage(uint32_t binding, vk::Buffer buffer,
+                       vk::DeviceSize range);
+
+    void bind(vk::CommandBuffer commandBuffer,
+              vk::PipelineLayout pipelineLayout) {
+        const uint32_t offset = uniformBuffer->offset();
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                         pipelineLayout, 0, 1,
+                                         &(*descriptorSet[0]), 1, &offset);
+    }
+
+  private:
+    void createDescriptorPool();
+    void createDescriptorSet(vk::DescriptorSetLayout descriptorSetLayout,
+                             vk::ImageView target);
+
+  private:
+    static constexpr uint32_t maxStorageBuffers = 2;
+
+    const shared_ptr<LogicalDevice> device;
+
+    vk::raii::DescriptorPool descriptorPool;
+    vector<vk::raii::DescriptorSet> descriptorSet;
+
+    shared_ptr<UniformRing<UniformBufferObject2>> uniformBuffer;
 };
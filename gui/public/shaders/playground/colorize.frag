@@ -0,0 +1,59 @@
+#version 450
+
+// Colours the iteration counts of the fractal layers. Runs on every frame, so
+// changing the colours doesn't require to iterate again.
+
+layout(location = 0) in vec2 fragTexCoord;
+
+// (iteration count, smoothing term) as written by the fractal shaders, i.e.
+// mandel.frag. 0 marks points inside the set, negative counts pixels without
+// data, e.g. around the zoom preview of InterlacedRenderer.
+layout(binding = 1) uniform sampler2D iterSampler;
+
+// same layout as ColorUniformBufferObject in ubo.h
+layout(binding = 2) uniform ColorUniformBufferObject {
+	float iGamma;
+	float shift;
+	float contrast;
+	float phase;
+	float smoothing;
+} ubo;
+
+layout(location = 0) out vec4 outColor;
+
+vec4 makeColors(vec2 iter) {
+	if (iter.x < 0.) {
+		// transparent, so the layer below shows through
+		return vec4(0.0);
+	}
+	if (iter.x == 0.) {
+		return vec4(0.0, 0.0, 0.0, 1.0);
+	}
+
+	float v = (iter.x - iter.y * ubo.smoothing) * 0.02;
+	v = ubo.contrast*v + ubo.shift;
+	float phase = ubo.phase;
+	return pow(sin(vec4(v, v + 1. * phase, v + 2. * phase, 1.0)) * 0.5 + 0.5, vec4(ubo.iGamma));
+}
+
+vec4 colorAt(ivec2 p, ivec2 size) {
+	return makeColors(texelFetch(iterSampler, clamp(p, ivec2(0), size - 1), 0).xy);
+}
+
+void main() {
+	// Interpolate the colours, not the counts: counts next to the set or of
+	// different bands don't mix. Float formats don't need to support linear
+	// filtering anyway.
+	ivec2 size = textureSize(iterSampler, 0);
+	vec2 t = fragTexCoord * vec2(size) - 0.5;
+	ivec2 p = ivec2(floor(t));
+	vec2 f = fract(t);
+
+	vec4 c = mix(
+		mix(colorAt(p, size), colorAt(p + ivec2(1, 0), size), f.x),
+		mix(colorAt(p + ivec2(0, 1), size), colorAt(p + ivec2(1, 1), size), f.x),
+		f.y);
+
+	// same channel order as pass.frag
+	outColor = c.zyxw;
+}
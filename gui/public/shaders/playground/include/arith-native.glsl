@@ -0,0 +1,24 @@
+// Complex numbers made of one real each for the real and the imaginary part.
+// The including shader defines real (float or double) and real2.
+
+#define cplx real2
+
+float magnitudeSquaredFast(cplx z) {
+	return float(z.x*z.x + z.y*z.y);
+}
+
+cplx imAdd(cplx x, cplx y){
+	return x + y;
+}
+
+cplx imSquare(cplx z){
+	return cplx(
+		z.x*z.x-z.y*z.y,
+		2*z.x*z.y
+	);
+}
+
+// imaginary part in the precision of real
+real imagHi(cplx z) {
+	return z.y;
+}
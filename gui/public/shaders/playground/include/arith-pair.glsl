@@ -0,0 +1,96 @@
+// Reals as unevaluated sums of two reals (hi, lo), which doubles the bits of
+// mantissa. The including shader defines real (float or double), real2,
+// real4 and PAIR_SPLIT = 2^ceil(mantissa bits / 2) + 1.
+//
+// The arithmetic is ported from the web version
+// (web/src/shaders/preamble/arith-float64.fs, after Dekker and Andrew Thall:
+// http://andrewthall.org/papers/df64_qf128.pdf). Instead of the fences, the
+// error terms are declared precise, which forbids the compiler to reassociate
+// or fuse them.
+
+// (Fast) Dekker sum, requires |a| >= |b|
+real2 quickTwoSum(real a, real b) {
+	precise real s = a + b;
+	precise real v = s - a;
+	precise real e = b - v;
+	return real2(s, e);
+}
+
+// Knuth sum of (a.x, b.x) and (a.y, b.y) as (s.x, e.x, s.y, e.y)
+real4 twoSum2(real2 a, real2 b) {
+	precise real2 s = a + b;
+	precise real2 v = s - a;
+	precise real2 e = (a - (s - v)) + (b - v);
+	return real4(s.x, e.x, s.y, e.y);
+}
+
+real2 add(real2 a, real2 b) {
+	real4 st = twoSum2(a, b);
+	st.y += st.z;
+	st.xy = quickTwoSum(st.x, st.y);
+	st.y += st.w;
+	return quickTwoSum(st.x, st.y);
+}
+
+real2 sub(real2 a, real2 b) {
+	return add(a, -b);
+}
+
+// splits a and b into (a.hi, b.hi, a.lo, b.lo) with half of the bits each
+real4 split2(real2 a) {
+	const real SPLIT = PAIR_SPLIT;
+	precise real2 t = a * SPLIT;
+	precise real2 hi = t - (t - a);
+	precise real2 lo = a - hi;
+	return real4(hi, lo);
+}
+
+real2 twoProd(real a, real b) {
+	precise real p = a * b;
+	real4 s = split2(real2(a, b));
+	precise real err = ((s.x * s.y - p) + s.x * s.w + s.z * s.y) + s.z * s.w;
+	return real2(p, err);
+}
+
+real2 mul(real2 a, real2 b) {
+	real2 p = twoProd(a.x, b.x);
+	precise real lo = p.y + a.x * b.y + a.y * b.x;
+	return quickTwoSum(p.x, lo);
+}
+
+real2 twoProdSquare(real a) {
+	precise real p = a * a;
+	real4 s = split2(real2(a));
+	precise real err = ((s.x * s.x - p) + 2. * s.x * s.z) + s.z * s.z;
+	return real2(p, err);
+}
+
+real2 square(real2 a) {
+	real2 p = twoProdSquare(a.x);
+	precise real lo = p.y + 2. * a.x * a.y;
+	return quickTwoSum(p.x, lo);
+}
+
+// complex numbers are (re.hi, re.lo, im.hi, im.lo)
+#define cplx real4
+
+cplx imAdd(cplx x, cplx y) {
+	return cplx(add(x.xy, y.xy), add(x.zw, y.zw));
+}
+
+cplx imSquare(cplx z) {
+	// multiplying with 2 is exact
+	return cplx(
+		sub(square(z.xy), square(z.zw)),
+		2. * mul(z.xy, z.zw)
+	);
+}
+
+float magnitudeSquaredFast(cplx z) {
+	return float(z.x*z.x + z.z*z.z);
+}
+
+// imaginary part in the precision of real
+real imagHi(cplx z) {
+	return z.z;
+}
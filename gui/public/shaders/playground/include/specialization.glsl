@@ -0,0 +1,6 @@
+// Specialization constants, see FractalSpecialization. Specialized pipelines
+// have maxIter and radius compiled in and only exist while play is 0. The
+// others read everything from the uniform buffer.
+layout(constant_id = 0) const bool SPECIALIZED = false;
+layout(constant_id = 1) const int SPEC_MAX_ITER = 0;
+layout(constant_id = 2) const float SPEC_RADIUS = 0.;
@@ -0,0 +1,14 @@
+// UniformBufferObject2 in ubo.h, up to the low part of pos
+layout(binding = 1) uniform UniformBufferObject2 {
+	dvec2 pos;
+    double zoom;
+	int maxIter;
+	float iGamma;
+	float play;
+	float shift;
+	float contrast;
+	float phase;
+	float radius;
+	float smoothing;
+	layout(offset = 96) dvec2 posLo;
+} ubo;
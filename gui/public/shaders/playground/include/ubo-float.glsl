@@ -0,0 +1,15 @@
+// same layout as UniformBufferObject2 in ubo.h, skipping the doubles
+layout(binding = 1) uniform UniformBufferObject2 {
+	layout(offset = 24) int maxIter;
+	float iGamma;
+	float play;
+	float shift;
+	float contrast;
+	float phase;
+	float radius;
+	float smoothing;
+	layout(offset = 88) float zoomMantissa;
+	int zoomExponent;
+	// (x.hi, x.lo, y.hi, y.lo)
+	layout(offset = 112) vec4 posFF;
+} ubo;
@@ -1,71 +1,118 @@
 #version 450
 
-layout(location = 0) in vec2 fragTexCoord;
-
-layout(location = 0) out vec4 outColor;
-
-
-layout(binding = 1) uniform UniformBufferObject2 {
-	vec2 pos;
-    float zoom;
-	int maxIter;
-} ubo;
-
-float magnitudeSquaredFast(vec2 z) {
-	return z.x*z.x + z.y*z.y;
-}
-
-vec2 imAdd(vec2 x, vec2 y){
-	return x + y;
-}
-
-vec2 imSquare(vec2 z){
-	return vec2(
-		z.x*z.x-z.y*z.y,
-		2*z.x*z.y
-	);
-}
-
-vec4 makeColors(float v) {
-	float contrast = 3.0;
-	float shift = 1.0;
-	float phase = 0.0;
-	float igamma = .7;
-
-    v = contrast*v + phase;
-    return pow(sin(vec4(v, v + 1. * shift, v + 2. * shift, 1.0)) * 0.5 + 0.5, vec4(igamma));
+// The Mandelbrot set without perturbation. The arithmetic is chosen by the
+// macro of the variant (see PrecisionSelector::shader):
+//
+// (none)                  floats, for shallow zooms
+// PRECISION_FLOAT_PAIR    emulated doubles: every real is an unevaluated sum
+//                         of two floats (hi, lo) with 48 bits of mantissa.
+//                         Consumer GPUs often run fp64 at 1/32 of the fp32
+//                         rate, so this is usually faster than native doubles
+//                         while it resolves zooms down to about 1e-10. There
+//                         are no doubles at all, so this also runs on devices
+//                         without shaderFloat64.
+// PRECISION_DOUBLE        native doubles
+// PRECISION_DOUBLE_DOUBLE pairs of doubles with 106 bits of mantissa. This
+//                         resolves zooms from 1e-13, where doubles run out,
+//                         down to about 1e-28.
+
+#if defined(PRECISION_DOUBLE) || defined(PRECISION_DOUBLE_DOUBLE)
+#include "include/ubo-double.glsl"
+#else
+#include "include/ubo-float.glsl"
+#endif
+
+#include "include/specialization.glsl"
+
+#if defined(PRECISION_DOUBLE_DOUBLE)
+#define real double
+#define real2 dvec2
+#define real4 dvec4
+#define PAIR_SPLIT 134217729. // (1 << 27) + 1
+#include "include/arith-pair.glsl"
+#elif defined(PRECISION_FLOAT_PAIR)
+#define real float
+#define real2 vec2
+#define real4 vec4
+#define PAIR_SPLIT 4097. // (1 << 12) + 1
+#include "include/arith-pair.glsl"
+#elif defined(PRECISION_DOUBLE)
+#define real double
+#define real2 dvec2
+#include "include/arith-native.glsl"
+#else
+#define real float
+#define real2 vec2
+#include "include/arith-native.glsl"
+#endif
+
+// c of the pixel
+cplx startPoint(vec2 fragTexCoord) {
+#if defined(PRECISION_DOUBLE)
+	return dvec2(fragTexCoord) * ubo.zoom + ubo.pos;
+#elif defined(PRECISION_DOUBLE_DOUBLE)
+	// the offset to the corner doesn't need the low part
+	dvec2 d = dvec2(fragTexCoord) * ubo.zoom;
+	return imAdd(dvec4(d.x, 0., d.y, 0.),
+	             dvec4(ubo.pos.x, ubo.posLo.x, ubo.pos.y, ubo.posLo.y));
+#elif defined(PRECISION_FLOAT_PAIR)
+	float zoom = ldexp(ubo.zoomMantissa, ubo.zoomExponent);
+	vec2 d = fragTexCoord * zoom;
+	return imAdd(vec4(d.x, 0., d.y, 0.), ubo.posFF);
+#else
+	float zoom = ldexp(ubo.zoomMantissa, ubo.zoomExponent);
+	return fragTexCoord * zoom + ubo.posFF.xz;
+#endif
 }
 
-void main() {
-	float cx = 4.0;
-	float smoothing = 1.0;
+// raw iteration count and smoothing term, coloured by colorize.frag
+vec2 iterate(vec2 fragTexCoord) {
+	float radius = SPECIALIZED ? SPEC_RADIUS : ubo.radius;
+	int maxIter = SPECIALIZED ? SPEC_MAX_ITER : ubo.maxIter;
 
 	////////////
 
-	vec2 z = fragTexCoord * ubo.zoom + ubo.pos;
-	vec2 p = vec2(0.);
-	float cx2 = (cx*cx);
+	cplx z = startPoint(fragTexCoord);
+	cplx p = cplx(0.);
+	float radius2 = (radius*radius);
 
-//	outColor = vec4( sin(vec3(iter)) * .5 + .5, 1.0);  
 	int i = maxIter;
-	for (int j=0; j <= maxIter; j++) {
-		p = imAdd(imSquare(p), z);
-		// p.x *= (1.+ c.y / float(j+1) / p.y / 50.);
-		if(magnitudeSquaredFast(p) > cx2) {
-			i = j;
-			break;
+	if (SPECIALIZED || ubo.play == 0) {
+		for (int j=0; j <= maxIter; j++) {
+			p = imAdd(imSquare(p), z);
+			if(magnitudeSquaredFast(p) > radius2) {
+				i = j;
+				break;
+			}
+		}
+	}else {
+		for (int j=0; j <= maxIter; j++) {
+			p = imAdd(imSquare(p), z);
+			p.x += p.x * ubo.play / float(j+1) / imagHi(p) / 50.;
+			if(magnitudeSquaredFast(p) > radius2) {
+				i = j;
+				break;
+			}
 		}
 	}
-	
-    // Smoothing
-    float log_zn = log(magnitudeSquaredFast(p)) * 0.5;
-    float nu = log(log_zn * 1.44269504088896) * 1.44269504088896 * smoothing;
 
-    float v = (float(i + 1) - nu) * 0.02; // + zx.x * 10.0;
-    outColor = (i >= (maxIter - 1))
-                    ? vec4(0.0)
-                    : makeColors(v);
+    // Smoothing, weighted with the smoothing parameter by colorize.frag
+    float log_zn = log(magnitudeSquaredFast(p)) * 0.5;
+    float nu = log(log_zn * 1.44269504088896) * 1.44269504088896;
 
-	// outColor = vec4(1.0);
+    // 0 marks points inside the set
+    return (i >= (maxIter - 1))
+                    ? vec2(0.0)
+                    : vec2(float(i + 1), nu);
 }
 
+// Entry point of the graphics backend. The compute backend appends
+// interlace.comp instead.
+#ifndef COMPUTE
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 0) out vec2 outIter;
+
+void main() {
+	outIter = iterate(fragTexCoord);
+}
+#endif
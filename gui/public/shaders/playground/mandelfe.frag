@@ -0,0 +1,164 @@
+#version 450
+
+// Version of mandelp.frag for zooms beyond the range of doubles (~1e-308).
+// Deltas are stored as a float mantissa and a separate exponent, e.g.
+// dz = w * 2^s. Inserting this in dz' = 2 Z dz + dz^2 + dc gives
+//
+//     w' = 2 Z w + 2^s w^2 + dc 2^-s
+//
+// which is iterated with plain floats. 2^s underflows to zero as long as the
+// quadratic term doesn't matter. The magnitude of w is only moved into s every
+// few iterations, so this runs at float speed. See floatExp.h.
+
+layout(binding = 1) uniform UniformBufferObject2 {
+	dvec2 pos;
+    double zoom;
+	int maxIter;
+	float iGamma;
+	float play;
+	float shift;
+	float contrast;
+	float phase;
+	float radius;
+	float smoothing;
+	dvec2 refOffset;
+	vec2 refOffsetScaled;
+	float zoomMantissa;
+	int zoomExponent;
+} ubo;
+
+#include "include/specialization.glsl"
+
+layout(std430, binding = 2) readonly buffer ReferenceOrbit {
+	dvec2 secondaryOffset;
+	int primaryLength;
+	int secondaryLength;
+	vec2 secondaryOffsetMantissa;
+	int secondaryOffsetExponent;
+	// primary orbit followed by the secondary orbit
+	dvec2 orbit[];
+} ref;
+
+// Pauldelbrot's criterion (squared)
+const float glitchTolerance = 1e-6;
+
+// must match Perturbation::rescaleInterval
+const int rescaleInterval = 8;
+
+float magnitudeSquared(vec2 z) {
+	return z.x*z.x + z.y*z.y;
+}
+
+vec2 imMul(vec2 a, vec2 b) {
+	return vec2(
+		a.x*b.x - a.y*b.y,
+		a.x*b.y + a.y*b.x
+	);
+}
+
+// m * 2^e, flushed to zero if it is too small for a float
+vec2 scaled(vec2 m, int e) {
+	return e < -126 ? vec2(0.) : ldexp(m, ivec2(min(e, 127)));
+}
+
+// raw iteration count and smoothing term, coloured by colorize.frag
+vec2 iterate(vec2 fragTexCoord) {
+	float radius = SPECIALIZED ? SPEC_RADIUS : ubo.radius;
+	int maxIter = SPECIALIZED ? SPEC_MAX_ITER : ubo.maxIter;
+
+	////////////
+
+	// offset to the reference point, dc = dcMantissa * 2^e
+	int e = ubo.zoomExponent;
+	vec2 dcMantissa = (fragTexCoord - 0.5) * ubo.zoomMantissa + ubo.refOffsetScaled;
+
+	// dz = w * 2^s, scale = 2^s, dcScaled = dc * 2^-s
+	vec2 w = vec2(0.);
+	int s = e;
+	float scale = scaled(vec2(1.), s).x;
+	vec2 dcScaled = dcMantissa;
+	vec2 p = vec2(0.);
+	float radius2 = (radius*radius);
+
+	// active orbit
+	int base = 0;
+	int len = ref.primaryLength;
+	bool secondary = false;
+	int n = 0;
+
+	// "play" is not analytic, so it can't be perturbed and is ignored here
+	int i = maxIter;
+	int j = 0;
+	while (j <= maxIter) {
+		if (j % rescaleInterval == 0) {
+			float m = max(abs(w.x), abs(w.y));
+			if (m > 0.) {
+				int k;
+				frexp(m, k);
+				w = ldexp(w, ivec2(-k));
+				s += k;
+				scale = scaled(vec2(1.), s).x;
+				dcScaled = scaled(dcMantissa, e - s);
+			}
+		}
+
+		vec2 Z = vec2(ref.orbit[base + n]);
+		w = imMul(2. * Z + scale * w, w) + dcScaled;
+		n++;
+
+		Z = vec2(ref.orbit[base + n]);
+		p = Z + scale * w;
+		float mag = magnitudeSquared(p);
+		if (mag > radius2) {
+			i = j;
+			break;
+		}
+
+		bool glitch = mag < glitchTolerance * magnitudeSquared(Z);
+		if (glitch && !secondary && ref.secondaryLength > 0) {
+			// render the pixel again using the secondary reference
+			secondary = true;
+			base = ref.primaryLength;
+			len = ref.secondaryLength;
+			dcMantissa += scaled(ref.secondaryOffsetMantissa, ref.secondaryOffsetExponent - e);
+			w = vec2(0.);
+			s = e;
+			scale = scaled(vec2(1.), s).x;
+			dcScaled = dcMantissa;
+			n = 0;
+			j = 0;
+			continue;
+		}
+
+		if (glitch || n == len - 1) {
+			// rebase onto the start of the orbit (or the reference escaped
+			// before the pixel did). z fits into a float.
+			w = p;
+			s = 0;
+			scale = 1.;
+			dcScaled = scaled(dcMantissa, e);
+			n = 0;
+		}
+		j++;
+	}
+
+    // Smoothing, weighted with the smoothing parameter by colorize.frag
+    float log_zn = log(magnitudeSquared(p)) * 0.5;
+    float nu = log(log_zn * 1.44269504088896) * 1.44269504088896;
+
+    // 0 marks points inside the set
+    return (i >= (maxIter - 1))
+                    ? vec2(0.0)
+                    : vec2(float(i + 1), nu);
+}
+
+// Entry point of the graphics backend. The compute backend appends
+// interlace.comp instead.
+#ifndef COMPUTE
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 0) out vec2 outIter;
+
+void main() {
+	outIter = iterate(fragTexCoord);
+}
+#endif
@@ -0,0 +1,167 @@
+#version 450
+
+// Perturbation version of mandel.frag with doubles. See perturbation.h for
+// the theory.
+
+layout(binding = 1) uniform UniformBufferObject2 {
+	dvec2 pos;
+    double zoom;
+	int maxIter;
+	float iGamma;
+	float play;
+	float shift;
+	float contrast;
+	float phase;
+	float radius;
+	float smoothing;
+	dvec2 refOffset;
+} ubo;
+
+#include "include/specialization.glsl"
+
+layout(std430, binding = 2) readonly buffer ReferenceOrbit {
+	dvec2 secondaryOffset;
+	int primaryLength;
+	int secondaryLength;
+	// only used by mandelfe.frag
+	vec2 secondaryOffsetMantissa;
+	int secondaryOffsetExponent;
+	// primary orbit followed by the secondary orbit
+	dvec2 orbit[];
+} ref;
+
+struct BLAStep {
+	dvec2 a;
+	dvec2 b;
+	double r2;
+};
+
+// bilinear approximation of the primary orbit, see bla.h
+layout(std430, binding = 3) readonly buffer BilinearApproximation {
+	int levels;
+	int levelStart[33];
+	BLAStep steps[];
+} bla;
+
+// Pauldelbrot's criterion (squared)
+const double glitchTolerance = 1e-6;
+
+float magnitudeSquaredFast(dvec2 z) {
+	return float(z.x*z.x + z.y*z.y);
+}
+
+double magnitudeSquared(dvec2 z) {
+	return z.x*z.x + z.y*z.y;
+}
+
+dvec2 imMul(dvec2 a, dvec2 b) {
+	return dvec2(
+		a.x*b.x - a.y*b.y,
+		a.x*b.y + a.y*b.x
+	);
+}
+
+// raw iteration count and smoothing term, coloured by colorize.frag
+vec2 iterate(vec2 fragTexCoord) {
+	float radius = SPECIALIZED ? SPEC_RADIUS : ubo.radius;
+	int maxIter = SPECIALIZED ? SPEC_MAX_ITER : ubo.maxIter;
+
+	////////////
+
+	// offset to the reference point
+	dvec2 dc = dvec2(fragTexCoord - 0.5) * ubo.zoom + ubo.refOffset;
+	dvec2 dz = dvec2(0.);
+	dvec2 p = dvec2(0.);
+	float radius2 = (radius*radius);
+
+	// active orbit
+	int base = 0;
+	int len = ref.primaryLength;
+	bool secondary = false;
+	int n = 0;
+
+	// "play" is not analytic, so it can't be perturbed and is ignored here
+	int i = maxIter;
+	int j = 0;
+	while (j <= maxIter) {
+		if (!secondary && n > 0 && bla.levels > 0) {
+			// skip as many iterations as possible. Steps of level k start at
+			// iterations 1 + x * 2^k.
+			int m = n - 1;
+			int top = m == 0 ? bla.levels - 1 : min(bla.levels - 1, findLSB(m));
+			double mag = magnitudeSquared(dz);
+			bool skipped = false;
+			for (int k = top; k >= 0; k--) {
+				int l = 1 << k;
+				int idx = bla.levelStart[k] + (m >> k);
+				if (idx >= bla.levelStart[k + 1] || j + l > maxIter)
+					continue;
+
+				BLAStep s = bla.steps[idx];
+				if (mag < s.r2) {
+					dz = imMul(s.a, dz) + imMul(s.b, dc);
+					n += l;
+					j += l;
+					skipped = true;
+					break;
+				}
+			}
+			if (skipped)
+				continue;
+		}
+
+		dz = imMul(2. * ref.orbit[base + n] + dz, dz) + dc;
+		n++;
+
+		dvec2 Z = ref.orbit[base + n];
+		p = Z + dz;
+		double mag = magnitudeSquared(p);
+		if (mag > radius2) {
+			i = j;
+			break;
+		}
+
+		if (mag < glitchTolerance * magnitudeSquared(Z)) {
+			if (!secondary && ref.secondaryLength > 0) {
+				// render the pixel again using the secondary reference
+				secondary = true;
+				base = ref.primaryLength;
+				len = ref.secondaryLength;
+				dc += ref.secondaryOffset;
+				dz = dvec2(0.);
+				n = 0;
+				j = 0;
+				continue;
+			}
+
+			// rebase onto the start of the orbit
+			dz = p;
+			n = 0;
+		} else if (n == len - 1) {
+			// the reference escaped before the pixel did
+			dz = p;
+			n = 0;
+		}
+		j++;
+	}
+
+    // Smoothing, weighted with the smoothing parameter by colorize.frag
+    float log_zn = log(magnitudeSquaredFast(p)) * 0.5;
+    float nu = log(log_zn * 1.44269504088896) * 1.44269504088896;
+
+    // 0 marks points inside the set
+    return (i >= (maxIter - 1))
+                    ? vec2(0.0)
+                    : vec2(float(i + 1), nu);
+}
+
+// Entry point of the graphics backend. The compute backend appends
+// interlace.comp instead.
+#ifndef COMPUTE
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 0) out vec2 outIter;
+
+void main() {
+	outIter = iterate(fragTexCoord);
+}
+#endif
@@ -339,7 +339,8 @@ export default class FatouApp extends Vue {
     @Getter getY;
     @Getter getZ;
     get formattedZ() {
-        return "2^" + Math.log2(this.getZ).toFixed(3);
+        // the zoom is sent as log2, it doesn't fit into a double
+        return "2^" + Number(this.getZ).toFixed(3);
     }
     @Getter getDevices;
     @Getter getMonitors;
@@ -392,8 +393,9 @@ export default class FatouApp extends Vue {
     }
 
     dynamicFormatZ(x: number) {
+        const digits = -Number(this.getZ) * Math.log10(2);
         return Number(x)
-            .toFixed(Math.min(20, Math.max(-Math.log10(this.getZ) + 4, 0)))
+            .toFixed(Math.min(20, Math.max(digits + 4, 0)))
             .replace(/0+$/, "");
     }
 
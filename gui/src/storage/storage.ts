@@ -20,6 +20,18 @@ export interface RenderParams {
     targetEffort?: number;
     renderTime?: number;
     fps?: number;
+    orbitTime?: number;
+    orbitLength?: number;
+    secondaryLength?: number;
+    orbitBits?: number;
+    blaTime?: number;
+    blaLevels?: number;
+    precision?: string;
+    backend?: string;
+    memoryBlocks?: number;
+    memoryAllocations?: number;
+    memoryAllocated?: number;
+    memoryUsed?: number;
 }
 
 export interface State {
@@ -54,7 +66,7 @@ export const store = new Vuex.Store<State>({
 
         x: "0",
         y: "0",
-        z: "1",
+        z: "0",
 
         renderParams: undefined,
     },